@@ -1,11 +1,19 @@
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_set>
+#include <vector>
+#include "ConnectFourDistributed.hpp"
+#include "ConnectFourGameClock.hpp"
 #include "ConnectFourPMCTS.hpp"
+#include "ConnectFourPerft.hpp"
+#include "ConnectFourSelfPlay.hpp"
 #include "ConnectFourState.hpp"
+#include "CpuDispatch.hpp"
 #include "FileIO.hpp"
 
 /**
@@ -67,17 +75,20 @@ double askBoundedDouble(const std::string& question, double lower,
 std::pair<std::pair<ConnectFourState::Player, PlaythroughMode>,
           std::vector<Decision>>
 testRandomVsHeuristic() {
-    const PlaythroughMode X_MODE = (rand() % 2 == 0)
+    const PlaythroughMode X_MODE = (randomInt() % 2 == 0)
                                        ? PlaythroughMode::RANDOM
                                        : PlaythroughMode::HEURISTIC;
     const PlaythroughMode O_MODE = (X_MODE == PlaythroughMode::RANDOM)
                                        ? PlaythroughMode::HEURISTIC
                                        : PlaythroughMode::RANDOM;
-    const double MAX_TIME = 1.0;
+    const double GAME_TIME = 10.0;
+    const double INCREMENT = 0.1;
     const long MIN_ITERATIONS = 20000;
     const DecisionCutoff CUTOFF_TYPE = DecisionCutoff::TIME;
 
     ConnectFourState game;
+    GameClock xClock(GAME_TIME, INCREMENT);
+    GameClock oClock(GAME_TIME, INCREMENT);
     std::vector<Decision> gameDecisions;
     int turn = 1;
 
@@ -94,11 +105,22 @@ testRandomVsHeuristic() {
         std::cout << "Turn: " << turn << '\n';
         std::cout << "Player " << PLAYER_REPR << " (" << MODE_REPR << ")\n";
 
-        Decision currentDecision = pMCTS_DecideColumn(
-            game, CURRENT_MODE, MAX_TIME, CUTOFF_TYPE, MIN_ITERATIONS, true);
+        GameClock& clock =
+            (game.currentPlayer() == ConnectFourState::Player::X) ? xClock
+                                                                  : oClock;
+        const double ALLOCATED = clock.allocate(game);
+        Decision currentDecision =
+            pMCTS_DecideColumn(game, CURRENT_MODE, ALLOCATED, CUTOFF_TYPE,
+                               MIN_ITERATIONS, true);
         currentDecision.turn = turn;
+        currentDecision.allocated = ALLOCATED;
+        clock.finish(currentDecision, turn);
         game.playColumn(currentDecision.column);
         std::cout << "Column " << currentDecision.column << " chosen\n";
+        std::cout << "Allocated " << ALLOCATED << "s, used "
+                  << clock.moves().back().used << "s, "
+                  << clock.remaining() << "s left"
+                  << (clock.moves().back().flagged ? ", flagged\n" : "\n");
         std::cout << game << "\n\n";
 
         gameDecisions.push_back(currentDecision);
@@ -106,6 +128,8 @@ testRandomVsHeuristic() {
         ++turn;
     }
 
+    std::cout << "Player X clock:\n" << xClock << "Player O clock:\n" << oClock;
+
     PlaythroughMode lastMode;
 
     if (!game.isDraw()) {
@@ -124,13 +148,36 @@ testRandomVsHeuristic() {
     return {{game.firstWinner(), lastMode}, gameDecisions};
 }
 
-void playGame() {
+std::vector<std::string> splitList(const std::string& str, char separator) {
+    std::vector<std::string> parts;
+    std::string current;
+    for (char c : str) {
+        if (c == separator) {
+            if (!current.empty()) {
+                parts.push_back(current);
+            }
+            current.clear();
+        } else {
+            current += c;
+        }
+    }
+    if (!current.empty()) {
+        parts.push_back(current);
+    }
+    return parts;
+}
+
+void playGame(const std::vector<std::string>& workerEndpoints = {},
+              const RootAllocation ALLOCATION = RootAllocation::ROUND_ROBIN) {
+    const std::string MODE_OPTION = getInput(
+        "Set computer playthrough to pure random, heuristics or patterns? "
+        "(r/h/p)",
+        {"r", "h", "p"});
     const PlaythroughMode pMCTS_MODE =
-        (getInput(
-             "Set computer playthrough to pure random or heuristics? (r/h)",
-             {"r", "h"}) == "r")
+        (MODE_OPTION == "r")
             ? PlaythroughMode::RANDOM
-            : PlaythroughMode::HEURISTIC;
+            : ((MODE_OPTION == "h") ? PlaythroughMode::HEURISTIC
+                                    : PlaythroughMode::PATTERN);
     myprintln();
 
     const DecisionCutoff AI_CUTOFF =
@@ -142,10 +189,16 @@ void playGame() {
 
     double MAX_DECISION_TIME = 1.0;
     const long iterations = 20000;
+    std::unique_ptr<GameClock> clock;
     if (AI_CUTOFF == DecisionCutoff::TIME) {
-        MAX_DECISION_TIME = askBoundedDouble(
-            "How many seconds can the computer take to decide? [0.1, 100]", 0.1,
-            100.0);
+        const double GAME_TIME = askBoundedDouble(
+            "How many seconds can the computer take for the whole game? "
+            "[0.01, 3600]",
+            0.01, 3600.0);
+        const double INCREMENT = askBoundedDouble(
+            "How many seconds does the computer gain after each move? [0, 60]",
+            0.0, 60.0);
+        clock.reset(new GameClock(GAME_TIME, INCREMENT));
     } else {
         std::cout << "Defaulting to " << iterations
                   << " playthroughs per possible move.\n";
@@ -154,6 +207,12 @@ void playGame() {
     myprintln();
     myprintln();
 
+    std::unique_ptr<WorkerPool> workers;
+    if (!workerEndpoints.empty()) {
+        workers.reset(new WorkerPool(workerEndpoints));
+        std::cout << "Using " << workers->liveWorkers() << " workers\n";
+    }
+
     ConnectFourState game;
     int turn = 1;
 
@@ -174,15 +233,28 @@ void playGame() {
         } else {
             print("Deciding...\r");
 
+            if (clock) {
+                MAX_DECISION_TIME = clock->allocate(game);
+            }
             Decision computerDecision =
-                pMCTS_DecideColumn(game, pMCTS_MODE, MAX_DECISION_TIME,
-                                   AI_CUTOFF, iterations, true);
+                workers ? workers->decideColumn(game, pMCTS_MODE,
+                                                MAX_DECISION_TIME, AI_CUTOFF,
+                                                iterations, true)
+                        : pMCTS_DecideColumn(game, pMCTS_MODE,
+                                             MAX_DECISION_TIME, AI_CUTOFF,
+                                             iterations, true, ALLOCATION);
             chosenColumn = computerDecision.column;
 
-            std::cout << "Computer O ("
-                      << (pMCTS_MODE == PlaythroughMode::HEURISTIC ? "Heuristic"
-                                                                   : "Random")
+            std::cout << "Computer O (" << playthroughModeToString(pMCTS_MODE)
                       << ") chose column " << chosenColumn << '\n';
+            if (clock) {
+                clock->finish(computerDecision, turn - 1);
+                std::cout << "Allocated " << MAX_DECISION_TIME << "s, used "
+                          << clock->moves().back().used << "s, "
+                          << clock->remaining() << "s left"
+                          << (clock->moves().back().flagged ? ", flagged\n"
+                                                            : "\n");
+            }
         }
 
         game.playColumn(chosenColumn);
@@ -197,9 +269,13 @@ void playGame() {
                 myprintln("Player O Won");
             }
 
-            return;
+            break;
         }
     }
+
+    if (clock) {
+        std::cout << "Computer clock:\n" << *clock;
+    }
 }
 
 void collectRandomVsHeuristicData(const std::string& filename, int tests = 10) {
@@ -208,9 +284,8 @@ void collectRandomVsHeuristicData(const std::string& filename, int tests = 10) {
     int drawScore = 0;
 
     FileManager fileWriter(filename, false);
-    fileWriter.write(
-        "turn,player,mode,cutoff,column,possible_columns,score,playthroughs,time,playthroughs_"
-        "per_second\n");
+    FileManager jsonWriter(filename + ".jsonl", false);
+    fileWriter.write(Decision::csvHeader() + '\n');
 
     for (int i = 0; i < tests; ++i) {
         auto gameData = testRandomVsHeuristic();
@@ -230,8 +305,10 @@ void collectRandomVsHeuristicData(const std::string& filename, int tests = 10) {
 
         for (const Decision& d : DECISIONS) {
             fileWriter.write(d.toCSV() + '\n');
+            jsonWriter.write(d.toJSON() + '\n');
         }
         fileWriter.flush();
+        jsonWriter.flush();
 
         std::cout << "Random: " << randomScore
                   << ", Heuristic: " << heuristicScore
@@ -242,11 +319,437 @@ void collectRandomVsHeuristicData(const std::string& filename, int tests = 10) {
                      std::to_string(drawScore) + '\n');
 }
 
-int main() {
-    srand(time(NULL));
+/**
+ * Tune pattern weights offline from self-play data. Every recorded position
+ * counts which patterns were offered and which one was chosen. A pattern's
+ * weight becomes how much more often it was chosen than a uniformly random
+ * policy would have chosen it.
+ */
+void tunePatternTable(const std::string& dataFilename,
+                      const std::string& filename) {
+    std::vector<double> chosen(PATTERN_COUNT, 0);
+    std::vector<double> expected(PATTERN_COUNT, 0);
+
+    const SelfPlayReader DATA(dataFilename);
+    for (const SelfPlayRecord& RECORD : DATA) {
+        const ConnectFourState GAME = RECORD.state();
+        const std::vector<int> LEGAL_COLUMNS = GAME.legalMoves();
+
+        for (int column : LEGAL_COLUMNS) {
+            expected[PatternTable::patternAt(GAME, column)] +=
+                1.0 / LEGAL_COLUMNS.size();
+        }
+        chosen[PatternTable::patternAt(GAME, RECORD.column)] += 1;
+    }
+    std::cout << "Tuned from " << DATA.size() << " positions\n";
+
+    PatternTable tuned;
+    for (int pattern = 0; pattern < PATTERN_COUNT; ++pattern) {
+        if (expected[pattern] > 0) {
+            tuned.setWeight(pattern,
+                            (chosen[pattern] + 1) / (expected[pattern] + 1));
+        }
+    }
+    tuned.save(filename);
+}
+
+/**
+ * Train a value network offline from self-play data, by stochastic gradient
+ * descent on the squared error between its value for X and the final result
+ * of each recorded position. Training runs in floating point with the same
+ * clipped activations as the quantized network, and the weights are then
+ * quantized to its fixed point scales.
+ */
+void trainValueNetwork(const std::string& dataFilename,
+                       const std::string& filename, int epochs = 30) {
+    const int INPUTS = ValueNetwork::INPUTS;
+    const int HIDDEN_1 = ValueNetwork::HIDDEN_1;
+    const int HIDDEN_2 = ValueNetwork::HIDDEN_2;
+    const double LEARNING_RATE = 0.005;
+    // Largest weights the int8 layers can hold at a scale of 64.
+    const double INT8_LIMIT = 127.0 / 64.0;
+
+    const SelfPlayReader DATA(dataFilename, RecordAccess::RANDOM);
+    if (DATA.size() == 0) {
+        throw std::runtime_error("\'" + dataFilename + "\' has no positions.");
+    }
+
+    const auto randomWeight = [](double scale) {
+        return scale * (2.0 * randomInt() / RANDOM_MAX - 1);
+    };
+    std::vector<double> w1(INPUTS * HIDDEN_1), b1(HIDDEN_1, 0.1);
+    std::vector<double> w2(HIDDEN_2 * HIDDEN_1), b2(HIDDEN_2, 0.1);
+    std::vector<double> wo(HIDDEN_2), bo(1, 0);
+    for (double& weight : w1) {
+        weight = randomWeight(0.1);
+    }
+    for (double& weight : w2) {
+        weight = randomWeight(0.3);
+    }
+    for (double& weight : wo) {
+        weight = randomWeight(0.3);
+    }
+    const auto clampInt8 = [INT8_LIMIT](double weight) {
+        return std::min(std::max(weight, -INT8_LIMIT), INT8_LIMIT);
+    };
+
+    std::vector<std::uint64_t> order(DATA.size());
+    for (std::uint64_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        for (std::uint64_t i = order.size() - 1; i > 0; --i) {
+            std::swap(order[i], order[randomInt() % (i + 1)]);
+        }
+
+        double loss = 0;
+        for (std::uint64_t index : order) {
+            const SelfPlayRecord& RECORD = DATA[index];
+            const ConnectFourState GAME = RECORD.state();
+            const double TARGET =
+                (RECORD.player() == ConnectFourState::Player::X)
+                    ? RECORD.result
+                    : -RECORD.result;
+
+            std::vector<int> features;
+            for (int row = 0; row < 6; ++row) {
+                for (int column = 0; column < 7; ++column) {
+                    const ConnectFourState::Player PIECE =
+                        GAME.pieceAt(column, row);
+                    if (PIECE != ConnectFourState::Player::None) {
+                        features.push_back(
+                            ValueNetwork::featureIndex(column, row, PIECE));
+                    }
+                }
+            }
+
+            std::vector<double> h1(b1), h2(b2);
+            for (int feature : features) {
+                for (int j = 0; j < HIDDEN_1; ++j) {
+                    h1[j] += w1[feature * HIDDEN_1 + j];
+                }
+            }
+            std::vector<double> a1(HIDDEN_1), a2(HIDDEN_2);
+            for (int j = 0; j < HIDDEN_1; ++j) {
+                a1[j] = std::min(std::max(h1[j], 0.0), 1.0);
+            }
+            for (int k = 0; k < HIDDEN_2; ++k) {
+                for (int j = 0; j < HIDDEN_1; ++j) {
+                    h2[k] += w2[k * HIDDEN_1 + j] * a1[j];
+                }
+                a2[k] = std::min(std::max(h2[k], 0.0), 1.0);
+            }
+            double output = bo[0];
+            for (int k = 0; k < HIDDEN_2; ++k) {
+                output += wo[k] * a2[k];
+            }
+            const double VALUE = std::tanh(output);
+            loss += (VALUE - TARGET) * (VALUE - TARGET);
+
+            // Backpropagate, with clipped units passing no gradient.
+            const double D_OUTPUT = 2 * (VALUE - TARGET) * (1 - VALUE * VALUE);
+            std::vector<double> d1(HIDDEN_1, 0);
+            for (int k = 0; k < HIDDEN_2; ++k) {
+                const double D2 =
+                    (h2[k] > 0 && h2[k] < 1) ? D_OUTPUT * wo[k] : 0;
+                wo[k] = clampInt8(wo[k] - LEARNING_RATE * D_OUTPUT * a2[k]);
+                if (D2 == 0) {
+                    continue;
+                }
+                for (int j = 0; j < HIDDEN_1; ++j) {
+                    double& weight = w2[k * HIDDEN_1 + j];
+                    d1[j] += D2 * weight;
+                    weight = clampInt8(weight - LEARNING_RATE * D2 * a1[j]);
+                }
+                b2[k] -= LEARNING_RATE * D2;
+            }
+            bo[0] -= LEARNING_RATE * D_OUTPUT;
+            for (int j = 0; j < HIDDEN_1; ++j) {
+                if (h1[j] <= 0 || h1[j] >= 1) {
+                    continue;
+                }
+                for (int feature : features) {
+                    w1[feature * HIDDEN_1 + j] -= LEARNING_RATE * d1[j];
+                }
+                b1[j] -= LEARNING_RATE * d1[j];
+            }
+        }
+        std::cout << "Epoch " << epoch + 1 << "/" << epochs
+                  << ", mean squared error " << loss / order.size() << '\n';
+    }
+
+    // Activations become [0, 127], second layer weights are scaled by 64
+    // and the output by 127 * 64.
+    const auto quantize = [](double value, double limit) {
+        return std::lround(std::min(std::max(value, -limit), limit));
+    };
+    std::unique_ptr<ValueNetwork> network(new ValueNetwork());
+    for (int i = 0; i < INPUTS; ++i) {
+        for (int j = 0; j < HIDDEN_1; ++j) {
+            network->firstWeights[i][j] =
+                quantize(127 * w1[i * HIDDEN_1 + j], 32767);
+        }
+    }
+    for (int j = 0; j < HIDDEN_1; ++j) {
+        network->firstBiases[j] = quantize(127 * b1[j], 32767);
+    }
+    for (int k = 0; k < HIDDEN_2; ++k) {
+        for (int j = 0; j < HIDDEN_1; ++j) {
+            network->secondWeights[k][j] =
+                quantize(64 * w2[k * HIDDEN_1 + j], 127);
+        }
+        network->secondBiases[k] = quantize(127 * 64 * b2[k], 1e9);
+        network->outputWeights[k] = quantize(64 * wo[k], 127);
+    }
+    network->outputBias = quantize(127 * 64 * bo[0], 1e9);
+    network->save(filename);
+    std::cout << "Trained on " << DATA.size() << " positions\n";
+}
+
+/**
+ * Compare the playthrough rate of time limited decisions from the empty board
+ * spread over the workers at ENDPOINTS with that of this process alone. When
+ * every endpoint is local the rates should add up, one process per core;
+ * returns false when they fall more than 20% short of that or a worker is
+ * dropped.
+ */
+bool benchmarkWorkers(const std::vector<std::string>& endpoints,
+                      const PlaythroughMode MODE, int decisions = 10,
+                      double seconds = 0.2) {
+    const ConnectFourState EMPTY;
+
+    const auto rate = [&](WorkerPool* pool) -> double {
+        long playthroughs = 0;
+        double time = 0;
+        for (int i = 0; i < decisions; ++i) {
+            const Decision DECISION =
+                pool ? pool->decideColumn(EMPTY, MODE, seconds)
+                     : pMCTS_DecideColumn(EMPTY, MODE, seconds);
+            playthroughs += DECISION.playthroughs;
+            time += DECISION.time;
+        }
+        return playthroughs / time;
+    };
+
+    const double ALONE = rate(nullptr);
+    WorkerPool pool(endpoints);
+    const int WORKERS = pool.liveWorkers();
+    const double SPREAD = rate(&pool);
+
+    bool local = true;
+    for (const std::string& endpoint : endpoints) {
+        local = local && distributed_ParseEndpoint(endpoint).first == "local";
+    }
+    const int EXPECTED = std::min<int>(
+        WORKERS + 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    std::cout << "Alone:        " << ALONE << " playthroughs/s\n"
+              << "With workers: " << SPREAD << " playthroughs/s ("
+              << SPREAD / ALONE << "x, " << pool.liveWorkers() << " of "
+              << WORKERS << " workers left)\n";
+    if (local) {
+        std::cout << "Expected:     " << EXPECTED << "x on "
+                  << std::thread::hardware_concurrency() << " cores\n";
+    }
+
+    return pool.liveWorkers() == WORKERS &&
+           (!local || SPREAD / ALONE >= 0.8 * EXPECTED);
+}
+
+/**
+ * Print the CPU target and the implementation each dispatched kernel runs.
+ */
+void printCpuReport() {
+    const CpuTarget TARGET = cpu_Target();
+    const std::string GENERIC_VECTOR =
+#if defined(__ARM_NEON)
+        "neon";
+#else
+        cpuTargetToString(CpuTarget::GENERIC);
+#endif
+
+    std::cout << "CPU target:    " << cpuTargetToString(TARGET)
+              << " (detected " << cpuTargetToString(cpu_Detect()) << ")\n"
+              << "Playthroughs:  " << cpuTargetToString(TARGET) << '\n'
+              << "Value network: "
+              << ((TARGET == CpuTarget::GENERIC) ? GENERIC_VECTOR
+                                                 : cpuTargetToString(TARGET))
+              << '\n';
+}
+
+/**
+ * Usage:
+ *      ConnectFour                         Play against the computer.
+ *      ConnectFour --worker <endpoint>     Serve playthrough jobs.
+ *      ConnectFour --workers <endpoints>   Play, spreading playthroughs over
+ *                                          comma separated worker endpoints.
+ *      ConnectFour --patterns <file>       Load pattern playthrough weights.
+ *      ConnectFour --network <file>        Seed column scores from a value
+ *                                          network.
+ *      ConnectFour --store <file>          Seed and save column statistics in
+ *                                          a shared position store.
+ *      ConnectFour --allocation <round-robin|ucb1|halving>
+ *                                          Share root playthroughs evenly, by
+ *                                          UCB1 or by sequential halving.
+ *      ConnectFour --no-early-termination  Play every playthrough to the end.
+ *      ConnectFour --rave                  Blend all-moves-as-first statistics
+ *                                          into column values.
+ *      ConnectFour --proof-nodes <n>       Look for forced wins and losses
+ *                                          with up to n proof search nodes
+ *                                          before every decision.
+ *      ConnectFour --cpu <auto|generic|x86-64-v3>
+ *                                          Override the CPU target kernels are
+ *                                          chosen for.
+ *      ConnectFour --cpu-report            Print the chosen kernels.
+ *      ConnectFour --profile               Record hardware counters for every
+ *                                          decision.
+ *      ConnectFour --self-play <file> <games> [--threads <n>]
+ *                  [--mode <random|heuristic|pattern>] [--iterations <n>]
+ *                                          Append self-play training data.
+ *      ConnectFour --tune-patterns <data file> <file>
+ *                                          Tune pattern weights from
+ *                                          self-play data.
+ *      ConnectFour --train-network <data file> <file>
+ *                                          Train value network weights from
+ *                                          self-play data.
+ *      ConnectFour --workers <endpoints> --benchmark-workers
+ *                  [--mode <random|heuristic|pattern>]
+ *                                          Check that workers add to the
+ *                                          playthrough rate.
+ *      ConnectFour --perft <depth> [--unique] [--threads <n>]
+ *                                          Count positions per depth, checking
+ *                                          unique counts against published
+ *                                          ones.
+ *
+ * Endpoints are "unix:/path", "tcp:host:port" or "local:N" (N forked workers).
+ */
+int main(int argc, char* argv[]) {
+    seedRandom(time(NULL));
+
+    std::vector<std::string> workerEndpoints;
+    RootAllocation allocation = RootAllocation::ROUND_ROBIN;
+    int perftDepth = -1;
+    bool perftUnique = false;
+    int threads = std::thread::hardware_concurrency();
+    std::string selfPlayFilename;
+    int selfPlayGames = 0;
+    PlaythroughMode selfPlayMode = PlaythroughMode::HEURISTIC;
+    long selfPlayIterations = 2000;
+    bool benchmark = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string ARGUMENT = argv[i];
+        if (ARGUMENT == "--worker" && i + 1 < argc) {
+            pMCTS_ServeWorker(argv[++i]);
+            return 0;
+        } else if (ARGUMENT == "--patterns" && i + 1 < argc) {
+            pMCTS_PatternTable().load(argv[++i]);
+        } else if (ARGUMENT == "--network" && i + 1 < argc) {
+            pMCTS_ValueNetwork().reset(new ValueNetwork());
+            pMCTS_ValueNetwork()->load(argv[++i]);
+        } else if (ARGUMENT == "--store" && i + 1 < argc) {
+            pMCTS_PositionStore().reset(new PositionStore(argv[++i]));
+        } else if (ARGUMENT == "--allocation" && i + 1 < argc) {
+            const std::string NAME = argv[++i];
+            if (NAME == "ucb1") {
+                allocation = RootAllocation::UCB1;
+            } else if (NAME == "halving") {
+                allocation = RootAllocation::SEQUENTIAL_HALVING;
+            } else if (NAME == "round-robin") {
+                allocation = RootAllocation::ROUND_ROBIN;
+            } else {
+                std::cerr << "Unknown allocation \'" << NAME << "\'\n";
+                return 1;
+            }
+        } else if (ARGUMENT == "--no-early-termination") {
+            pMCTS_EarlyTermination() = false;
+        } else if (ARGUMENT == "--rave") {
+            pMCTS_Rave() = true;
+        } else if (ARGUMENT == "--proof-nodes" && i + 1 < argc) {
+            pMCTS_ProofNodes() = std::max(std::stol(argv[++i]), 0L);
+            // Allocate the table now rather than in the first decision.
+            pMCTS_ProofSearch();
+        } else if (ARGUMENT == "--cpu" && i + 1 < argc) {
+            try {
+                cpu_Select(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return 1;
+            }
+        } else if (ARGUMENT == "--cpu-report") {
+            printCpuReport();
+        } else if (ARGUMENT == "--profile") {
+            pMCTS_Profiling() = true;
+            if (!threadPerfCounters().available()) {
+                std::cerr << "Hardware counters are unavailable, decisions "
+                             "will report -1\n";
+            }
+        } else if (ARGUMENT == "--train-network" && i + 2 < argc) {
+            const std::string DATA_FILENAME = argv[++i];
+            trainValueNetwork(DATA_FILENAME, argv[++i]);
+            return 0;
+        } else if (ARGUMENT == "--tune-patterns" && i + 2 < argc) {
+            const std::string DATA_FILENAME = argv[++i];
+            tunePatternTable(DATA_FILENAME, argv[++i]);
+            return 0;
+        } else if (ARGUMENT == "--self-play" && i + 2 < argc) {
+            selfPlayFilename = argv[++i];
+            selfPlayGames = std::stoi(argv[++i]);
+        } else if (ARGUMENT == "--mode" && i + 1 < argc) {
+            const std::string NAME = argv[++i];
+            if (NAME == "random") {
+                selfPlayMode = PlaythroughMode::RANDOM;
+            } else if (NAME == "heuristic") {
+                selfPlayMode = PlaythroughMode::HEURISTIC;
+            } else if (NAME == "pattern") {
+                selfPlayMode = PlaythroughMode::PATTERN;
+            } else {
+                std::cerr << "Unknown mode \'" << NAME << "\'\n";
+                return 1;
+            }
+        } else if (ARGUMENT == "--iterations" && i + 1 < argc) {
+            selfPlayIterations = std::stol(argv[++i]);
+        } else if (ARGUMENT == "--perft" && i + 1 < argc) {
+            perftDepth = std::stoi(argv[++i]);
+        } else if (ARGUMENT == "--unique") {
+            perftUnique = true;
+        } else if (ARGUMENT == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (ARGUMENT == "--workers" && i + 1 < argc) {
+            workerEndpoints = splitList(argv[++i], ',');
+        } else if (ARGUMENT == "--benchmark-workers") {
+            benchmark = true;
+        } else {
+            std::cerr << "Unknown argument \'" << ARGUMENT << "\'\n";
+            return 1;
+        }
+    }
+
+    if (perftDepth >= 0) {
+        return perft_Report(perftDepth, perftUnique, threads) ? 0 : 1;
+    }
+
+    if (benchmark) {
+        return benchmarkWorkers(workerEndpoints, selfPlayMode) ? 0 : 1;
+    }
+
+    if (!selfPlayFilename.empty()) {
+        const std::uint64_t POSITIONS =
+            selfPlay(selfPlayFilename, selfPlayGames, threads, selfPlayMode,
+                     selfPlayIterations, allocation);
+        std::cout << "Wrote " << POSITIONS << " positions\n";
+        return 0;
+    }
+
+    if (!workerEndpoints.empty() &&
+        (allocation != RootAllocation::ROUND_ROBIN || pMCTS_Rave())) {
+        std::cerr << "Workers share playthroughs round robin without RAVE, "
+                     "--allocation and --rave are ignored with --workers\n";
+    }
 
     // collectRandomVsHeuristicData("data/RVH_DATA_TIME_100R", 100);
-    playGame();
+    playGame(workerEndpoints, allocation);
 
     std::string temp;
     print("Enter any key to quit: ");
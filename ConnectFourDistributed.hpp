@@ -0,0 +1,835 @@
+#pragma once
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourPMCTS.hpp"
+#include "ConnectFourState.hpp"
+#include "Random.hpp"
+
+/**
+ * Coordinator/worker mode for pMCTS.
+ *
+ * A coordinator splits the playthrough budget of a decision into jobs of
+ * (position, child column, playthrough quota, seed) and sends them to worker
+ * processes, which answer with win/loss/draw counts. Workers are reached over
+ * a Unix socket ("unix:/path"), TCP ("tcp:host:port"), or are forked locally
+ * and connected through a socket pair ("local:N").
+ *
+ * The protocol is line based:
+ *
+ *      JOB <id> <encoded child state> <R|H|P> <quota> <milliseconds> <seed>
+ *      RESULT <id> <wins> <losses> <draws>
+ *
+ * Outcomes are counted for the player that moved into the child state. A job
+ * with a positive millisecond limit stops early when that many milliseconds
+ * have passed since its line arrived, so jobs sent together share one time
+ * budget however long the earlier ones take. Workers cap every job at
+ * WORKER_MAX_QUOTA playthroughs and WORKER_MAX_MILLISECONDS, and coordinators
+ * reject results with more playthroughs than they asked for. Pattern
+ * playthroughs use the worker's own pattern table.
+ *
+ * Workers accept jobs from anyone who can connect, so TCP workers must only
+ * listen on trusted interfaces.
+ *
+ * Citations
+ *
+ *  https://man7.org/linux/man-pages/man2/poll.2.html
+ *      Waiting on several worker connections at once.
+ *
+ *  https://man7.org/linux/man-pages/man3/getaddrinfo.3.html
+ *      Resolving TCP endpoints.
+ */
+
+const int WORKER_LISTEN_BACKLOG = 16;
+
+// Bounds on a single job, whatever the coordinator asks for, so a bad job
+// cannot keep a worker busy indefinitely.
+const long WORKER_MAX_QUOTA = 100000000;
+const double WORKER_MAX_MILLISECONDS = 60000;
+// A job line is far shorter; a connection sending more without a newline is
+// dropped.
+const size_t WORKER_MAX_LINE_LENGTH = 4096;
+
+// One playthrough per nanosecond, more than any worker runs even when the
+// result is settled at once, to bound the quotas of time limited jobs.
+const long DISTRIBUTED_MAX_PLAYTHROUGHS_PER_MILLISECOND = 1000000;
+
+/**
+ * Send the whole string, failing instead of raising SIGPIPE when the peer is
+ * gone.
+ */
+bool distributed_SendAll(int fd, const std::string& message) {
+    size_t sent = 0;
+    while (sent < message.size()) {
+        const ssize_t RESULT = send(fd, message.data() + sent,
+                                    message.size() - sent, MSG_NOSIGNAL);
+        if (RESULT < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += RESULT;
+    }
+    return true;
+}
+
+/**
+ * Split "unix:/path", "tcp:host:port" or "local:N" into its kind and address.
+ */
+std::pair<std::string, std::string> distributed_ParseEndpoint(
+    const std::string& endpoint) {
+    const size_t SEPARATOR = endpoint.find(':');
+    if (SEPARATOR == std::string::npos) {
+        throw std::invalid_argument("\'" + endpoint +
+                                    "\' is not a worker endpoint.");
+    }
+    const std::string KIND = endpoint.substr(0, SEPARATOR);
+    const std::string ADDRESS = endpoint.substr(SEPARATOR + 1);
+    if ((KIND != "unix" && KIND != "tcp" && KIND != "local") ||
+        ADDRESS.empty()) {
+        throw std::invalid_argument("\'" + endpoint +
+                                    "\' is not a worker endpoint.");
+    }
+    return {KIND, ADDRESS};
+}
+
+std::pair<std::string, std::string> distributed_SplitHostPort(
+    const std::string& address) {
+    const size_t SEPARATOR = address.rfind(':');
+    if (SEPARATOR == std::string::npos) {
+        throw std::invalid_argument("\'" + address +
+                                    "\' must be in the form host:port.");
+    }
+    return {address.substr(0, SEPARATOR), address.substr(SEPARATOR + 1)};
+}
+
+/**
+ * Open a listening socket for a "unix:" or "tcp:" endpoint.
+ */
+int distributed_Listen(const std::string& endpoint) {
+    const auto PARSED = distributed_ParseEndpoint(endpoint);
+
+    if (PARSED.first == "unix") {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (PARSED.second.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("\'" + PARSED.second +
+                                        "\' is too long for a socket path.");
+        }
+        std::strcpy(address.sun_path, PARSED.second.c_str());
+        unlink(address.sun_path);
+
+        const int FD = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (FD < 0 ||
+            bind(FD, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+                0 ||
+            listen(FD, WORKER_LISTEN_BACKLOG) < 0) {
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be listened on: " +
+                                     std::strerror(errno));
+        }
+        return FD;
+    }
+
+    if (PARSED.first == "tcp") {
+        const auto HOST_PORT = distributed_SplitHostPort(PARSED.second);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        addrinfo* results = nullptr;
+        const char* HOST =
+            (HOST_PORT.first.empty() || HOST_PORT.first == "*")
+                ? nullptr
+                : HOST_PORT.first.c_str();
+        if (getaddrinfo(HOST, HOST_PORT.second.c_str(), &hints, &results) !=
+            0) {
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be resolved.");
+        }
+
+        int fd = -1;
+        for (addrinfo* candidate = results; candidate != nullptr;
+             candidate = candidate->ai_next) {
+            fd = socket(candidate->ai_family, candidate->ai_socktype,
+                        candidate->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            const int REUSE = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &REUSE, sizeof(REUSE));
+            if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 &&
+                listen(fd, WORKER_LISTEN_BACKLOG) == 0) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(results);
+
+        if (fd < 0) {
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be listened on.");
+        }
+        return fd;
+    }
+
+    throw std::invalid_argument("\'" + endpoint +
+                                "\' cannot be listened on by a worker.");
+}
+
+/**
+ * Connect to a "unix:" or "tcp:" worker endpoint.
+ */
+int distributed_Connect(const std::string& endpoint) {
+    const auto PARSED = distributed_ParseEndpoint(endpoint);
+
+    if (PARSED.first == "unix") {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (PARSED.second.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("\'" + PARSED.second +
+                                        "\' is too long for a socket path.");
+        }
+        std::strcpy(address.sun_path, PARSED.second.c_str());
+
+        const int FD = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (FD < 0 || connect(FD, reinterpret_cast<sockaddr*>(&address),
+                              sizeof(address)) < 0) {
+            if (FD >= 0) {
+                close(FD);
+            }
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be connected to: " +
+                                     std::strerror(errno));
+        }
+        return FD;
+    }
+
+    if (PARSED.first == "tcp") {
+        const auto HOST_PORT = distributed_SplitHostPort(PARSED.second);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo* results = nullptr;
+        if (getaddrinfo(HOST_PORT.first.c_str(), HOST_PORT.second.c_str(),
+                        &hints, &results) != 0) {
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be resolved.");
+        }
+
+        int fd = -1;
+        for (addrinfo* candidate = results; candidate != nullptr;
+             candidate = candidate->ai_next) {
+            fd = socket(candidate->ai_family, candidate->ai_socktype,
+                        candidate->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(results);
+
+        if (fd < 0) {
+            throw std::runtime_error("\'" + endpoint +
+                                     "\' could not be connected to.");
+        }
+
+        // Jobs and results are small, send them immediately.
+        const int NO_DELAY = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &NO_DELAY, sizeof(NO_DELAY));
+        return fd;
+    }
+
+    throw std::invalid_argument("\'" + endpoint +
+                                "\' cannot be connected to directly.");
+}
+
+/**
+ * Answer a single job line that arrived at RECEIVED. Returns an empty string
+ * for lines that are not jobs.
+ */
+std::string distributed_HandleJob(
+    const std::string& line,
+    const std::chrono::steady_clock::time_point RECEIVED =
+        std::chrono::steady_clock::now()) {
+    std::istringstream tokens(line);
+    std::string command;
+    long id;
+    std::string encodedState;
+    std::string mode;
+    long quota;
+    double milliseconds;
+    unsigned int seed;
+
+    if (!(tokens >> command >> id >> encodedState >> mode >> quota >>
+          milliseconds >> seed) ||
+        command != "JOB") {
+        return "";
+    }
+
+    quota = std::max(0L, std::min(quota, WORKER_MAX_QUOTA));
+    if (!(milliseconds > 0 && milliseconds < WORKER_MAX_MILLISECONDS)) {
+        milliseconds = WORKER_MAX_MILLISECONDS;
+    }
+
+    seedRandom(seed);
+    const PlaythroughTally TALLY = pMCTS_RunPlaythroughs(
+        ConnectFourState::decode(encodedState),
+        (mode == "R") ? PlaythroughMode::RANDOM
+                      : ((mode == "H") ? PlaythroughMode::HEURISTIC
+                                       : PlaythroughMode::PATTERN),
+        quota, milliseconds, RECEIVED);
+
+    return "RESULT " + std::to_string(id) + " " + std::to_string(TALLY.wins) +
+           " " + std::to_string(TALLY.losses) + " " +
+           std::to_string(TALLY.draws) + "\n";
+}
+
+/**
+ * Process jobs from one coordinator connection until it is closed.
+ */
+void distributed_ServeConnection(int fd) {
+    std::string buffer;
+    char chunk[4096];
+
+    while (true) {
+        const ssize_t RECEIVED = recv(fd, chunk, sizeof(chunk), 0);
+        if (RECEIVED < 0 && errno == EINTR) {
+            continue;
+        }
+        if (RECEIVED <= 0) {
+            return;
+        }
+        const std::chrono::steady_clock::time_point RECEIVED_AT =
+            std::chrono::steady_clock::now();
+        buffer.append(chunk, RECEIVED);
+
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            const std::string LINE = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+
+            std::string reply;
+            try {
+                reply = distributed_HandleJob(LINE, RECEIVED_AT);
+            } catch (const std::exception& e) {
+                std::cerr << "Rejected job: " << e.what() << '\n';
+            }
+
+            if (!reply.empty() && !distributed_SendAll(fd, reply)) {
+                return;
+            }
+        }
+
+        if (buffer.size() > WORKER_MAX_LINE_LENGTH) {
+            std::cerr << "Rejected connection: line too long\n";
+            return;
+        }
+    }
+}
+
+/**
+ * Run a worker that serves coordinators on a "unix:" or "tcp:" endpoint,
+ * one connection at a time. Jobs are not authenticated, so "tcp:" endpoints
+ * must be bound to trusted interfaces only. Does not return.
+ */
+void pMCTS_ServeWorker(const std::string& endpoint) {
+    const int LISTEN_FD = distributed_Listen(endpoint);
+    std::cout << "Worker listening on " << endpoint << '\n';
+
+    while (true) {
+        const int CONNECTION_FD = accept(LISTEN_FD, nullptr, nullptr);
+        if (CONNECTION_FD < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("accept failed: ") +
+                                     std::strerror(errno));
+        }
+        distributed_ServeConnection(CONNECTION_FD);
+        close(CONNECTION_FD);
+    }
+}
+
+/**
+ * Connections to a set of workers, used to spread the playthroughs of each
+ * decision. Workers that fail are dropped and their jobs are run locally.
+ */
+class WorkerPool {
+   public:
+    WorkerPool(const std::vector<std::string>& endpoints,
+               double timeoutSeconds = 5.0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int liveWorkers() const;
+
+    Decision decideColumn(const ConnectFourState& STATE,
+                          const PlaythroughMode MODE,
+                          const double MAX_SECONDS = 5.0,
+                          const DecisionCutoff CUTOFF = DecisionCutoff::TIME,
+                          const long MINIMUM_ITERATIONS = 20000,
+                          const bool PRINT_STATISTICS = false);
+
+   private:
+    struct Worker {
+        std::string endpoint;
+        int fd;
+        pid_t pid;
+        std::string buffer;
+    };
+
+    struct Job {
+        int childIndex;
+        int worker;
+        long quota;
+        double milliseconds;
+        bool done;
+    };
+
+    const double _TIMEOUT_SECONDS;
+    std::vector<Worker> _workers;
+
+    void _spawnLocalWorkers(int count);
+    void _dropWorker(int worker);
+};
+
+WorkerPool::WorkerPool(const std::vector<std::string>& endpoints,
+                       double timeoutSeconds)
+    : _TIMEOUT_SECONDS(timeoutSeconds) {
+    for (const std::string& endpoint : endpoints) {
+        const auto PARSED = distributed_ParseEndpoint(endpoint);
+        if (PARSED.first == "local") {
+            _spawnLocalWorkers(std::stoi(PARSED.second));
+        } else {
+            _workers.push_back({endpoint, distributed_Connect(endpoint), -1, ""});
+        }
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    for (int i = 0; i < _workers.size(); ++i) {
+        _dropWorker(i);
+    }
+}
+
+int WorkerPool::liveWorkers() const {
+    int live = 0;
+    for (const Worker& worker : _workers) {
+        if (worker.fd >= 0) {
+            ++live;
+        }
+    }
+    return live;
+}
+
+void WorkerPool::_spawnLocalWorkers(int count) {
+    for (int i = 0; i < count; ++i) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            throw std::runtime_error(std::string("socketpair failed: ") +
+                                     std::strerror(errno));
+        }
+
+        std::cout.flush();
+        const pid_t PID = fork();
+        if (PID < 0) {
+            throw std::runtime_error(std::string("fork failed: ") +
+                                     std::strerror(errno));
+        }
+
+        if (PID == 0) {
+            close(fds[0]);
+            // Connections to earlier workers belong to the coordinator.
+            for (const Worker& worker : _workers) {
+                if (worker.fd >= 0) {
+                    close(worker.fd);
+                }
+            }
+            distributed_ServeConnection(fds[1]);
+            _exit(0);
+        }
+
+        close(fds[1]);
+        _workers.push_back({"local:" + std::to_string(i), fds[0], PID, ""});
+    }
+}
+
+void WorkerPool::_dropWorker(int worker) {
+    Worker& dropped = _workers[worker];
+    if (dropped.fd >= 0) {
+        close(dropped.fd);
+        dropped.fd = -1;
+    }
+    if (dropped.pid > 0) {
+        kill(dropped.pid, SIGTERM);
+        waitpid(dropped.pid, nullptr, 0);
+        dropped.pid = -1;
+    }
+    dropped.buffer.clear();
+}
+
+/**
+ * Equivalent to pMCTS_DecideColumn with round robin allocation, with the
+ * playthroughs of every column split evenly across the live workers and the
+ * coordinator itself. With an iteration cutoff each of them gets a share of
+ * the per-column iterations. With a time cutoff each worker's jobs share the
+ * time left, the coordinator plays rounds over every column until the limit,
+ * and workers that have not answered shortly after the limit are dropped.
+ * Columns that end the game are only played by the coordinator. The
+ * coordinator runs the proof search first, when enabled.
+ */
+Decision WorkerPool::decideColumn(const ConnectFourState& STATE,
+                                  const PlaythroughMode MODE,
+                                  const double MAX_SECONDS,
+                                  const DecisionCutoff CUTOFF,
+                                  const long MINIMUM_ITERATIONS,
+                                  const bool PRINT_STATISTICS) {
+    if (STATE.isOver()) {
+        throw std::runtime_error(
+            "The game cannot be played further. (It is in a draw.)");
+    }
+
+    const ConnectFourState::Player DECIDING_PLAYER = STATE.currentPlayer();
+    const bool CUTOFF_ON_TIME = CUTOFF == DecisionCutoff::TIME;
+    if (CUTOFF_ON_TIME && !(MAX_SECONDS > 0)) {
+        throw std::invalid_argument("The maximum time must be positive.");
+    }
+    const std::chrono::steady_clock::time_point START_TIME =
+        std::chrono::steady_clock::now();
+
+    // The coordinator runs the proof search, as pMCTS_DecideColumn does.
+    const ProofResult PROOF =
+        pMCTS_Prove(STATE, CUTOFF_ON_TIME, START_TIME, MAX_SECONDS);
+    if (PROOF.outcome == ProofOutcome::WIN) {
+        return pMCTS_ProvenWinDecision(STATE, MODE, MAX_SECONDS, CUTOFF,
+                                       START_TIME, PROOF);
+    }
+    const std::vector<int> COLUMNS = pMCTS_UnprovenColumns(STATE, PROOF);
+
+    std::vector<std::pair<int, std::pair<ConnectFourState, PlaythroughTally>>>
+        childStates;
+    for (int playableColumn : COLUMNS) {
+        childStates.push_back({playableColumn,
+                               {STATE.applyMove(playableColumn),
+                                PlaythroughTally()}});
+    }
+
+    const std::vector<PlaythroughTally> PRIORS =
+        pMCTS_PriorTallies(STATE, COLUMNS);
+
+    std::vector<int> live;
+    for (int i = 0; i < _workers.size(); ++i) {
+        if (_workers[i].fd >= 0) {
+            live.push_back(i);
+        }
+    }
+
+    // Columns that end the game have a known outcome and are scored by the
+    // coordinator alone.
+    std::vector<int> sent;
+    for (int child = 0; child < childStates.size(); ++child) {
+        if (!childStates[child].second.first.isOver()) {
+            sent.push_back(child);
+        }
+    }
+
+    // Each worker runs its jobs one after another, and their limits count
+    // from when they arrive, so under a time cutoff the k-th job of a worker
+    // ends k shares of the time left after they were sent. Quotas only bound
+    // what a worker may claim to have played in that time.
+    const double LEFT_MILLISECONDS =
+        std::max(0.01, MAX_SECONDS * 1000 - millisecondsSince(START_TIME));
+    const double JOB_MILLISECONDS =
+        (CUTOFF_ON_TIME && !sent.empty()) ? LEFT_MILLISECONDS / sent.size()
+                                          : 0;
+    const long TIME_QUOTA = static_cast<long>(std::min<double>(
+        WORKER_MAX_QUOTA, std::ceil(LEFT_MILLISECONDS) *
+                              DISTRIBUTED_MAX_PLAYTHROUGHS_PER_MILLISECOND));
+    const std::string MODE_CODE = playthroughModeToString(MODE).substr(0, 1);
+
+    // The coordinator takes the last share of the iterations.
+    const long SHARES = live.size() + 1;
+    const auto shareOf = [&](long slot) -> long {
+        return MINIMUM_ITERATIONS / SHARES +
+               ((slot < MINIMUM_ITERATIONS % SHARES) ? 1 : 0);
+    };
+
+    std::vector<Job> jobs;
+    std::vector<std::string> messages(_workers.size());
+    for (int slot = 0; slot < live.size(); ++slot) {
+        for (int k = 0; k < sent.size(); ++k) {
+            const Job JOB = {sent[k], live[slot],
+                             CUTOFF_ON_TIME ? TIME_QUOTA : shareOf(slot),
+                             JOB_MILLISECONDS * (k + 1), false};
+            messages[JOB.worker] +=
+                "JOB " + std::to_string(jobs.size()) + " " +
+                childStates[JOB.childIndex].second.first.encode() + " " +
+                MODE_CODE + " " + std::to_string(JOB.quota) + " " +
+                std::to_string(JOB.milliseconds) + " " +
+                std::to_string(randomInt()) + "\n";
+            jobs.push_back(JOB);
+        }
+    }
+
+    // A worker's jobs go in one message, so they arrive together.
+    for (int worker : live) {
+        if (!distributed_SendAll(_workers[worker].fd, messages[worker])) {
+            std::cerr << "Worker " << _workers[worker].endpoint
+                      << " failed\n";
+            _dropWorker(worker);
+        }
+    }
+
+    // The coordinator's own share, while the workers run theirs.
+    if (CUTOFF_ON_TIME) {
+        PlaythroughDeadline deadline(START_TIME, MAX_SECONDS);
+        for (int i = randomInt() % childStates.size(); !deadline.expired();
+             i = (i + 1) % childStates.size()) {
+            childStates[i].second.second.record(
+                pMCTS_PlaythroughWinner(childStates[i].second.first, MODE),
+                DECIDING_PLAYER);
+        }
+    } else {
+        for (auto& child : childStates) {
+            const long QUOTA = child.second.first.isOver()
+                                   ? MINIMUM_ITERATIONS
+                                   : shareOf(SHARES - 1);
+            child.second.second.merge(
+                pMCTS_RunPlaythroughs(child.second.first, MODE, QUOTA, 0));
+        }
+    }
+
+    // A worker that has jobs left but has not answered for longer than one
+    // job should take, plus the timeout, is considered lost. Under a time
+    // cutoff nobody waits much past the limit: a little slack for the
+    // network, bounded by the timeout.
+    const double SILENCE_LIMIT_MILLISECONDS =
+        JOB_MILLISECONDS + _TIMEOUT_SECONDS * 1000;
+    const double GIVE_UP_MILLISECONDS =
+        CUTOFF_ON_TIME
+            ? MAX_SECONDS * 1000 +
+                  std::min(_TIMEOUT_SECONDS * 1000, 5 + MAX_SECONDS * 100)
+            : INFINITY;
+    // Answers that arrived while the coordinator was busy are still unread.
+    std::vector<double> lastHeard(_workers.size(),
+                                  millisecondsSince(START_TIME));
+
+    const auto hasOutstandingJobs = [&](int worker) -> bool {
+        for (const Job& job : jobs) {
+            if (!job.done && job.worker == worker) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (true) {
+        std::vector<pollfd> polled;
+        std::vector<int> polledWorkers;
+        double waitMilliseconds = SILENCE_LIMIT_MILLISECONDS;
+        for (int i = 0; i < _workers.size(); ++i) {
+            if (_workers[i].fd < 0 || !hasOutstandingJobs(i)) {
+                continue;
+            }
+            const double NOW = millisecondsSince(START_TIME);
+            const double SILENT_FOR = NOW - lastHeard[i];
+            if (SILENT_FOR > SILENCE_LIMIT_MILLISECONDS ||
+                NOW > GIVE_UP_MILLISECONDS) {
+                std::cerr << "Worker " << _workers[i].endpoint
+                          << " timed out\n";
+                _dropWorker(i);
+                continue;
+            }
+            waitMilliseconds =
+                std::min({waitMilliseconds,
+                          SILENCE_LIMIT_MILLISECONDS - SILENT_FOR,
+                          GIVE_UP_MILLISECONDS - NOW});
+            polled.push_back({_workers[i].fd, POLLIN, 0});
+            polledWorkers.push_back(i);
+        }
+
+        if (polled.empty()) {
+            break;
+        }
+
+        const int READY = poll(polled.data(), polled.size(),
+                               static_cast<int>(waitMilliseconds) + 1);
+        if (READY < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int p = 0; p < polled.size(); ++p) {
+            if (polled[p].revents == 0) {
+                continue;
+            }
+            Worker& worker = _workers[polledWorkers[p]];
+
+            char chunk[4096];
+            const ssize_t RECEIVED = recv(worker.fd, chunk, sizeof(chunk), 0);
+            if (RECEIVED <= 0) {
+                std::cerr << "Worker " << worker.endpoint << " failed\n";
+                _dropWorker(polledWorkers[p]);
+                continue;
+            }
+            worker.buffer.append(chunk, RECEIVED);
+            lastHeard[polledWorkers[p]] = millisecondsSince(START_TIME);
+
+            size_t newline;
+            while ((newline = worker.buffer.find('\n')) != std::string::npos) {
+                std::istringstream tokens(worker.buffer.substr(0, newline));
+                worker.buffer.erase(0, newline + 1);
+
+                std::string command;
+                long id;
+                PlaythroughTally tally;
+                if (!(tokens >> command >> id >> tally.wins >> tally.losses >>
+                      tally.draws) ||
+                    command != "RESULT" || id < 0 || id >= jobs.size() ||
+                    jobs[id].done || jobs[id].worker != polledWorkers[p]) {
+                    continue;
+                }
+                // No more playthroughs than were asked for, so a bad result
+                // cannot overflow the tallies.
+                const long QUOTA = jobs[id].quota;
+                if (tally.wins < 0 || tally.losses < 0 || tally.draws < 0 ||
+                    tally.losses > QUOTA ||
+                    tally.draws > QUOTA - tally.losses ||
+                    tally.wins > QUOTA - tally.losses - tally.draws) {
+                    std::cerr << "Worker " << worker.endpoint
+                              << " sent an invalid result\n";
+                    _dropWorker(polledWorkers[p]);
+                    break;
+                }
+                childStates[jobs[id].childIndex].second.second.merge(tally);
+                jobs[id].done = true;
+            }
+        }
+    }
+
+    // Anything still outstanding belongs to a failed or timed out worker.
+    // Under a time cutoff what is left of the time is split evenly between
+    // those jobs, and they are skipped once it is gone; the coordinator's own
+    // share already covers every column.
+    std::vector<Job*> leftover;
+    for (Job& job : jobs) {
+        if (job.done) {
+            continue;
+        }
+        if (_workers[job.worker].fd >= 0) {
+            std::cerr << "Worker " << _workers[job.worker].endpoint
+                      << " timed out\n";
+            _dropWorker(job.worker);
+        }
+        leftover.push_back(&job);
+    }
+    for (int i = 0; i < leftover.size(); ++i) {
+        Job& job = *leftover[i];
+        double milliseconds = 0;
+        if (CUTOFF_ON_TIME) {
+            milliseconds =
+                (MAX_SECONDS * 1000 - millisecondsSince(START_TIME)) /
+                (leftover.size() - i);
+            if (milliseconds <= 0) {
+                break;
+            }
+        }
+        childStates[job.childIndex].second.second.merge(pMCTS_RunPlaythroughs(
+            childStates[job.childIndex].second.first, MODE, job.quota,
+            milliseconds));
+        job.done = true;
+    }
+
+    const long double MS_TIME_SPENT = millisecondsSince(START_TIME);
+
+    long playthroughs = 0;
+    int bestColumn = -1;
+    int bestScore = INT_MIN;
+    double bestValue = -1;
+    int ties = 0;
+
+    // Priors and lost workers leave columns with different numbers of
+    // playthroughs, so averages are compared, as in pMCTS_DecideColumn.
+    for (int i = 0; i < childStates.size(); ++i) {
+        const int COLUMN = childStates[i].first;
+        PlaythroughTally combined = PRIORS[i];
+        combined.merge(childStates[i].second.second);
+        const double VALUE = combined.mean();
+        playthroughs += childStates[i].second.second.playthroughs();
+        if (VALUE > bestValue) {
+            ties = 0;
+        }
+        if (VALUE >= bestValue && randomInt() % ++ties == 0) {
+            bestColumn = COLUMN;
+            bestScore = combined.score();
+            bestValue = VALUE;
+        }
+    }
+
+    std::vector<PlaythroughTally> tallies;
+    for (const auto& CHILD : childStates) {
+        tallies.push_back(CHILD.second.second);
+    }
+    pMCTS_StoreTallies(STATE, COLUMNS, tallies);
+
+    if (PRINT_STATISTICS) {
+        std::cout << "========================================\n";
+        std::cout << "Workers:          " << liveWorkers() << '\n'
+                  << "Playthroughs:     " << playthroughs << '\n'
+                  << "Playthroughs/sec: "
+                  << (playthroughs /
+                      static_cast<long double>(MS_TIME_SPENT / 1000))
+                  << '\n'
+                  << "Time:             " << (MS_TIME_SPENT / 1000) << "s"
+                  << '\n';
+        std::cout << "========================================\n";
+    }
+
+    Decision decision(DECIDING_PLAYER, MODE, CUTOFF, bestColumn,
+                      childStates.size(), bestScore, playthroughs,
+                      MS_TIME_SPENT / 1000);
+    decision.proof = PROOF.outcome;
+    decision.proofNodes = PROOF.nodes;
+    if (CUTOFF_ON_TIME) {
+        decision.overshoot = std::max(
+            0.0, static_cast<double>(MS_TIME_SPENT / 1000) - MAX_SECONDS);
+    }
+    for (int i = 0; i < childStates.size(); ++i) {
+        decision.columns.push_back({COLUMNS[i], tallies[i]});
+    }
+    return decision;
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourPMCTS.hpp"
+#include "ConnectFourState.hpp"
+
+/**
+ * A player's clock for a whole game: a total budget, plus an increment after
+ * every move, shared out between the player's decisions.
+ *
+ * Each move gets the time left, less a reserve, divided by the moves the
+ * player can still have to make, plus the increment. That share is then
+ * scaled:
+ *  - By the phase of the game. The opening is cheap to get roughly right and
+ *    the middle game decides most games.
+ *  - By the number of candidate columns. A forced reply (the only legal
+ *    column, or the only cell that blocks an immediate win) and an immediate
+ *    win get the minimum.
+ *  - By how unstable the player's previous search was, measured by how close
+ *    the runner-up column came to the chosen one.
+ *
+ * No move gets more than half of what is left above the reserve. Decisions
+ * overshoot their limits (finishing a round of playthroughs, evaluating
+ * priors, waiting for workers), so the clock also sets aside the average
+ * overshoot so far for every move left, and the reserve covers the rest. The
+ * minimum per move is lowered to an even share of what is left when that is
+ * smaller, and a budget too small to give every move the least time a
+ * decision can take is rejected. A move that takes longer than the time left
+ * is recorded as flagged.
+ *
+ * Citations
+ *
+ *  Robert Hyatt, "Using Time Wisely", ICCA Journal 7(1), 1984.
+ *      Sharing a budget by expected moves left, and spending more when the
+ *      best move is unclear.
+ *
+ *  Hendrik Baier and Mark Winands, "Time Management for Monte Carlo Tree
+ *  Search", IEEE Transactions on Computational Intelligence and AI in Games,
+ *  2016.
+ */
+
+// Seconds every decision gets while the clock can afford it.
+const double CLOCK_MIN_SECONDS = 0.001;
+// Seconds every decision gets, however little is left: about what one round
+// of heuristic playthroughs from the empty board takes.
+const double CLOCK_LEAST_SECONDS = 0.0001;
+// The most moves one player can make in a game.
+const int CLOCK_MAX_MOVES = 21;
+
+// One decision made on the clock.
+struct ClockMove {
+    int turn;
+    double allocated;
+    double used;
+    // Seconds left after the move and its increment.
+    double remaining;
+    // Whether the move used more than the time that was left.
+    bool flagged;
+};
+
+class GameClock {
+   public:
+    GameClock(double totalSeconds, double incrementSeconds = 0);
+
+    double allocate(const ConnectFourState& STATE);
+    void finish(const Decision& DECISION, int turn = -1);
+
+    double remaining() const;
+    double instability() const;
+    bool flagged() const;
+    const std::vector<ClockMove>& moves() const;
+
+    friend std::ostream& operator<<(std::ostream& os, const GameClock& clock);
+
+   private:
+    const double _TOTAL;
+    const double _INCREMENT;
+    const double _RESERVE;
+    double _remaining;
+    double _instability;
+    double _allocated;
+    double _overshoot;
+    std::chrono::steady_clock::time_point _moveStart;
+    std::vector<ClockMove> _moves;
+
+    static int _candidateColumns(const ConnectFourState& STATE);
+    static double _phaseWeight(int ply);
+};
+
+GameClock::GameClock(double totalSeconds, double incrementSeconds)
+    : _TOTAL(totalSeconds),
+      _INCREMENT(incrementSeconds),
+      _RESERVE(0.02 * totalSeconds + 0.005),
+      _remaining(totalSeconds),
+      _instability(0),
+      _allocated(0),
+      _overshoot(0) {
+    if (!(totalSeconds > 0) || !(incrementSeconds >= 0)) {
+        throw std::invalid_argument(
+            "A game clock needs a positive total and a non-negative "
+            "increment.");
+    }
+    if (totalSeconds + CLOCK_MAX_MOVES * incrementSeconds <
+        _RESERVE + CLOCK_MAX_MOVES * CLOCK_LEAST_SECONDS) {
+        throw std::invalid_argument(
+            "\'" + std::to_string(totalSeconds) + "\' seconds and \'" +
+            std::to_string(incrementSeconds) +
+            "\' per move cannot cover the clock's reserve and every move.");
+    }
+}
+
+/**
+ * Get the number of columns worth searching: 1 when the player to move can
+ * win at once or has only one way to block the opponent's immediate win.
+ */
+int GameClock::_candidateColumns(const ConnectFourState& STATE) {
+    const ConnectFourState::Player PLAYER = STATE.currentPlayer();
+    const ConnectFourState::Player OPPONENT =
+        (PLAYER == ConnectFourState::Player::X) ? ConnectFourState::Player::O
+                                                : ConnectFourState::Player::X;
+    const std::uint64_t PLAYABLE = STATE.playableCells();
+
+    if ((STATE.winningCells(PLAYER) & PLAYABLE) != 0) {
+        return 1;
+    }
+    const std::uint64_t THREATS = STATE.winningCells(OPPONENT) & PLAYABLE;
+    if (THREATS != 0) {
+        // Two or more threats lose whatever is played.
+        return (__builtin_popcountll(THREATS) == 1) ? 1 : 0;
+    }
+    return __builtin_popcountll(PLAYABLE);
+}
+
+double GameClock::_phaseWeight(int ply) {
+    if (ply < 4) {
+        return 0.6;
+    }
+    if (ply < 24) {
+        return 1.25;
+    }
+    return 0.9;
+}
+
+/**
+ * Get the seconds to decide on STATE, and start timing the decision.
+ */
+double GameClock::allocate(const ConnectFourState& STATE) {
+    _moveStart = std::chrono::steady_clock::now();
+
+    const std::uint64_t OCCUPIED =
+        STATE.playerMask(ConnectFourState::Player::X) |
+        STATE.playerMask(ConnectFourState::Player::O);
+    const int PLY = __builtin_popcountll(OCCUPIED);
+    const int CANDIDATES = _candidateColumns(STATE);
+    const int MOVES_LEFT = std::max((42 - PLY + 1) / 2, 1);
+    const double AVAILABLE =
+        std::max(0.0, _remaining - _RESERVE - MOVES_LEFT * _overshoot);
+    const double SHARE = AVAILABLE / MOVES_LEFT + _INCREMENT;
+    const double FLOOR =
+        std::max(CLOCK_LEAST_SECONDS, std::min(CLOCK_MIN_SECONDS, SHARE));
+
+    if (CANDIDATES <= 1) {
+        _allocated = FLOOR;
+        return _allocated;
+    }
+
+    const double BREADTH = std::sqrt(CANDIDATES / 7.0);
+    const double SECONDS =
+        SHARE * _phaseWeight(PLY) * BREADTH * (1 + _instability);
+
+    _allocated = std::max(FLOOR, std::min(SECONDS, AVAILABLE / 2));
+    return _allocated;
+}
+
+/**
+ * Stop timing the decision started by the last allocate(), charge it to the
+ * clock and remember how far it overshot and how unstable its search was.
+ */
+void GameClock::finish(const Decision& DECISION, int turn) {
+    const double USED = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - _moveStart)
+                            .count();
+    const bool FLAGGED = USED > _remaining;
+    _remaining = _remaining - USED + _INCREMENT;
+    _overshoot = (_overshoot * _moves.size() +
+                  std::max(0.0, USED - _allocated)) /
+                 (_moves.size() + 1);
+
+    // A runner-up within 5% of the chosen column's mean is fully unstable.
+    double chosen = -1;
+    double runnerUp = -1;
+    for (const auto& COLUMN : DECISION.columns) {
+        if (COLUMN.second.playthroughs() == 0) {
+            continue;
+        }
+        if (COLUMN.first == DECISION.column) {
+            chosen = COLUMN.second.mean();
+        } else {
+            runnerUp = std::max(runnerUp, COLUMN.second.mean());
+        }
+    }
+    _instability =
+        (chosen < 0 || runnerUp < 0 || DECISION.proof != ProofOutcome::UNKNOWN)
+            ? 0
+            : std::max(0.0, std::min(1.0, 1 - (chosen - runnerUp) / 0.05));
+
+    _moves.push_back({turn, _allocated, USED, _remaining, FLAGGED});
+}
+
+double GameClock::remaining() const { return _remaining; }
+
+double GameClock::instability() const { return _instability; }
+
+bool GameClock::flagged() const {
+    for (const ClockMove& MOVE : _moves) {
+        if (MOVE.flagged) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<ClockMove>& GameClock::moves() const { return _moves; }
+
+std::ostream& operator<<(std::ostream& os, const GameClock& clock) {
+    double allocated = 0;
+    double used = 0;
+    os << "Turn\tAllocated (s)\tUsed (s)\tRemaining (s)\tFlagged\n";
+    for (const ClockMove& MOVE : clock._moves) {
+        allocated += MOVE.allocated;
+        used += MOVE.used;
+        os << MOVE.turn << '\t' << std::to_string(MOVE.allocated) << '\t'
+           << std::to_string(MOVE.used) << '\t'
+           << std::to_string(MOVE.remaining) << '\t'
+           << (MOVE.flagged ? "yes" : "no") << '\n';
+    }
+    os << "Total\t" << std::to_string(allocated) << '\t'
+       << std::to_string(used) << "\t(of " << std::to_string(clock._TOTAL)
+       << " + " << std::to_string(clock._INCREMENT) << " per move)\t"
+       << (clock.flagged() ? "flagged" : "not flagged") << '\n';
+    return os;
+}
@@ -2,25 +2,99 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
+#include "ConnectFourPatterns.hpp"
+#include "ConnectFourPositionStore.hpp"
+#include "ConnectFourProofSearch.hpp"
 #include "ConnectFourState.hpp"
+#include "ConnectFourValueNetwork.hpp"
+#include "CpuDispatch.hpp"
+#include "PerfCounters.hpp"
+#include "Random.hpp"
 
 /**
  * Citations
  *
- *  https://en.cppreference.com/w/cpp/chrono/high_resolution_clock
- *      High resolution clock for accurate time keeping.
+ *  https://en.cppreference.com/w/cpp/chrono/steady_clock
+ *      Monotonic clock for accurate time keeping.
+ *
+ *  Sylvain Gelly and David Silver, "Combining Online and Offline Knowledge
+ *  in UCT", ICML 2007.
+ *      All-moves-as-first statistics and the RAVE weight.
  *
  */
 
-enum class PlaythroughMode { RANDOM, HEURISTIC };
+enum class PlaythroughMode { RANDOM, HEURISTIC, PATTERN };
 enum class DecisionCutoff { TIME, ITERATIONS };
 
+/**
+ * How root playthroughs are shared between columns.
+ *
+ *  ROUND_ROBIN         Every column gets the same number of playthroughs.
+ *  UCB1                Each playthrough goes to the column with the highest
+ *                      upper confidence bound.
+ *  SEQUENTIAL_HALVING  The budget is split into log2(columns) rounds, and the
+ *                      worse half of the columns is dropped after each round.
+ */
+enum class RootAllocation { ROUND_ROBIN, UCB1, SEQUENTIAL_HALVING };
+
+std::string playthroughModeToString(PlaythroughMode mode) {
+    switch (mode) {
+        case PlaythroughMode::RANDOM:
+            return "RANDOM";
+        case PlaythroughMode::HEURISTIC:
+            return "HEURISTIC";
+        case PlaythroughMode::PATTERN:
+            return "PATTERN";
+        default:
+            throw std::logic_error("An unknown playthrough mode was passed.");
+    }
+}
+
+/**
+ * Outcome counts of playthroughs, seen from the player deciding the move.
+ */
+struct PlaythroughTally {
+    long wins = 0;
+    long losses = 0;
+    long draws = 0;
+
+    void record(ConnectFourState::Player firstWinner,
+                ConnectFourState::Player decidingPlayer) {
+        if (firstWinner == decidingPlayer) {
+            ++wins;
+        } else if (firstWinner == ConnectFourState::Player::None) {
+            ++draws;
+        } else {
+            ++losses;
+        }
+    }
+
+    void merge(const PlaythroughTally& other) {
+        wins += other.wins;
+        losses += other.losses;
+        draws += other.draws;
+    }
+
+    long playthroughs() const { return wins + losses + draws; }
+
+    // Draws are neutral.
+    int score() const { return wins - losses; }
+
+    // Expected reward in [0, 1], with a draw worth half a win.
+    double mean() const {
+        const long PLAYTHROUGHS = playthroughs();
+        return (PLAYTHROUGHS == 0) ? 0.5 : (wins + 0.5 * draws) / PLAYTHROUGHS;
+    }
+};
+
 struct Decision {
     Decision(ConnectFourState::Player player, PlaythroughMode mode,
              DecisionCutoff cutoff, int column, int possibleColumns, int score,
@@ -33,7 +107,11 @@ struct Decision {
           score(score),
           playthroughs(playthroughs),
           time(time),
-          turn(-1) {}
+          turn(-1),
+          overshoot(0),
+          allocated(0),
+          proof(ProofOutcome::UNKNOWN),
+          proofNodes(0) {}
     ~Decision() {}
 
     const ConnectFourState::Player player;
@@ -45,20 +123,75 @@ struct Decision {
     const long playthroughs;
     const double time;
     int turn;
+    // Seconds spent past a time limit, 0 when within it or cut off by
+    // iterations.
+    double overshoot;
+    // Seconds a game clock allotted the decision, 0 without a clock.
+    double allocated;
+    // What proof search settled about the position, and the nodes it
+    // searched. A proven win is played without playthroughs.
+    ProofOutcome proof;
+    long proofNodes;
+    // Hardware counters per search phase, empty unless profiling.
+    PerfProfile profile;
+    // Playthrough outcomes of each legal column, without priors.
+    std::vector<std::pair<int, PlaythroughTally>> columns;
+
+    PerfSample totalProfile() const {
+        for (const auto& PHASE : profile) {
+            if (PHASE.first == "total") {
+                return PHASE.second;
+            }
+        }
+        return PerfSample();
+    }
+
+    static std::string csvHeader() {
+        return "turn,player,mode,cutoff,column,possible_columns,score,"
+               "playthroughs,time,playthroughs_per_second,overshoot,"
+               "allocated,proof,proof_nodes," +
+               PerfSample::csvHeader();
+    }
 
     std::string toCSV() const {
         const long double PLAYTHROUGHS_PER_SECOND = playthroughs / time;
         const std::string PLAYER_REPR =
             ConnectFourState::playerToString(player);
-        const std::string MODE_REPR =
-            (mode == PlaythroughMode::RANDOM) ? "RANDOM" : "HEURISTIC";
+        const std::string MODE_REPR = playthroughModeToString(mode);
         const std::string CUTOFF_REPR =
             (cutoff == DecisionCutoff::ITERATIONS) ? "ITERATIONS" : "TIME";
         return std::to_string(turn) + "," + PLAYER_REPR + "," + MODE_REPR +
                "," + CUTOFF_REPR + "," + std::to_string(column) + "," +
                std::to_string(possibleColumns) + "," + std::to_string(score) +
                "," + std::to_string(playthroughs) + "," + std::to_string(time) +
-               "," + std::to_string(PLAYTHROUGHS_PER_SECOND);
+               "," + std::to_string(PLAYTHROUGHS_PER_SECOND) + "," +
+               std::to_string(overshoot) + "," + std::to_string(allocated) +
+               "," + proofOutcomeToString(proof) + "," +
+               std::to_string(proofNodes) + "," +
+               totalProfile().toCSV();
+    }
+
+    std::string toJSON() const {
+        std::string phases;
+        for (const auto& PHASE : profile) {
+            phases += std::string(phases.empty() ? "" : ",") + "\"" +
+                      PHASE.first + "\":" + PHASE.second.toJSON();
+        }
+        return "{\"turn\":" + std::to_string(turn) + ",\"player\":\"" +
+               ConnectFourState::playerToString(player) + "\",\"mode\":\"" +
+               playthroughModeToString(mode) + "\",\"cutoff\":\"" +
+               ((cutoff == DecisionCutoff::ITERATIONS) ? "ITERATIONS"
+                                                       : "TIME") +
+               "\",\"column\":" + std::to_string(column) +
+               ",\"possible_columns\":" + std::to_string(possibleColumns) +
+               ",\"score\":" + std::to_string(score) +
+               ",\"playthroughs\":" + std::to_string(playthroughs) +
+               ",\"time\":" + std::to_string(time) + ",\"overshoot\":" +
+               std::to_string(overshoot) +
+               ",\"allocated\":" + std::to_string(allocated) +
+               ",\"proof\":\"" + proofOutcomeToString(proof) + "\"" +
+               ",\"proof_nodes\":" + std::to_string(proofNodes) +
+               ",\"profile\":{" + phases + "}}";
     }
 
     friend std::ostream& operator<<(std::ostream& os,
@@ -67,8 +200,7 @@ struct Decision {
             decision.playthroughs / decision.time;
         const std::string PLAYER_REPR =
             ConnectFourState::playerToString(decision.player);
-        const std::string MODE_REPR =
-            (decision.mode == PlaythroughMode::RANDOM) ? "RANDOM" : "HEURISTIC";
+        const std::string MODE_REPR = playthroughModeToString(decision.mode);
         const std::string CUTOFF_REPR =
             (decision.cutoff == DecisionCutoff::ITERATIONS) ? "ITERATIONS"
                                                             : "TIME";
@@ -83,9 +215,17 @@ struct Decision {
             "\n\tScore:            " + std::to_string(decision.score) +
             "\n\tPlaythroughs:     " + std::to_string(decision.playthroughs) +
             "\n\tTime (seconds):   " + std::to_string(decision.time) +
-            "\n\tPlaythroughs/sec: " + std::to_string(PLAYTHROUGHS_PER_SECOND);
+            "\n\tPlaythroughs/sec: " + std::to_string(PLAYTHROUGHS_PER_SECOND) +
+            "\n\tOvershoot (s):    " + std::to_string(decision.overshoot) +
+            "\n\tAllocated (s):    " + std::to_string(decision.allocated) +
+            "\n\tProof:            " + proofOutcomeToString(decision.proof) +
+            "\n\tProof nodes:      " + std::to_string(decision.proofNodes);
 
         os << REPR;
+        for (const auto& PHASE : decision.profile) {
+            os << "\n\tCounters (" << PHASE.first
+               << "): " << PHASE.second.toJSON();
+        }
         return os;
     }
 };
@@ -93,33 +233,177 @@ struct Decision {
 template <typename T>
 T randomElement(const std::vector<T>& container) {
     if (!container.empty()) {
-        return container[rand() % container.size()];
+        return container[randomInt() % container.size()];
     }
     throw std::runtime_error("The container is empty.");
 }
 
-double millisecondsSince(
-    const std::chrono::high_resolution_clock::time_point& TIME) {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               std::chrono::high_resolution_clock::now() - TIME)
+double millisecondsSince(const std::chrono::steady_clock::time_point& TIME) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - TIME)
         .count();
 }
 
-ConnectFourState pMCTS_RandomPlaythrough(const ConnectFourState& START_STATE) {
+/**
+ * A deadline checked between playthroughs. Reading the clock after every
+ * playthrough would cost a noticeable share of a short one, so the clock is
+ * only read every few calls: as many as are expected to fit in
+ * _CHECK_INTERVAL_SECONDS at the rate measured since the last reading. The
+ * deadline is then overshot by about one check interval at most, plus
+ * whatever the last playthrough takes.
+ */
+class PlaythroughDeadline {
+   public:
+    PlaythroughDeadline(const std::chrono::steady_clock::time_point& START,
+                        double seconds);
+
+    bool expired();
+
+   private:
+    static constexpr double _CHECK_INTERVAL_SECONDS = 10e-6;
+
+    const std::chrono::steady_clock::time_point _END;
+    std::chrono::steady_clock::time_point _lastCheck;
+    long _calls;
+    long _stride;
+    bool _expired;
+};
+
+PlaythroughDeadline::PlaythroughDeadline(
+    const std::chrono::steady_clock::time_point& START, double seconds)
+    : _END(START + std::chrono::duration_cast<
+                       std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double>(seconds))),
+      _lastCheck(START),
+      _calls(0),
+      _stride(1),
+      _expired(false) {}
+
+bool PlaythroughDeadline::expired() {
+    if (_expired) {
+        return true;
+    }
+    if (++_calls < _stride) {
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point NOW =
+        std::chrono::steady_clock::now();
+    if (NOW >= _END) {
+        _expired = true;
+        return true;
+    }
+
+    const double SECONDS_PER_CALL =
+        std::chrono::duration<double>(NOW - _lastCheck).count() / _calls;
+    const double SECONDS_TO_CHECK = std::min(
+        _CHECK_INTERVAL_SECONDS,
+        std::chrono::duration<double>(_END - NOW).count());
+    // Grow the stride gradually, the first readings include setup time
+    // rather than playthroughs.
+    _stride = std::max(
+        1L, std::min(2 * _stride,
+                     static_cast<long>(SECONDS_TO_CHECK /
+                                       std::max(SECONDS_PER_CALL, 1e-9))));
+    _calls = 0;
+    _lastCheck = NOW;
+    return false;
+}
+
+/**
+ * Whether playthroughs stop as soon as their result is known.
+ */
+bool& pMCTS_EarlyTermination() {
+    static bool earlyTermination = true;
+    return earlyTermination;
+}
+
+/**
+ * Find if the result of an unfinished game is already settled, without
+ * playing it out:
+ *  - The player to move can win immediately.
+ *  - The other player has two immediate wins, or an immediate win with
+ *    another winning cell right above it, and the player to move cannot win
+ *    first. Only one can be blocked, or blocking opens the cell above.
+ *  - Neither player can complete four in a row any more, so it is a draw.
+ */
+bool pMCTS_SettledResult(const ConnectFourState& STATE,
+                         ConnectFourState::Player& winner) {
+    const ConnectFourState::Player CURRENT = STATE.currentPlayer();
+    const ConnectFourState::Player OTHER =
+        (CURRENT == ConnectFourState::Player::X) ? ConnectFourState::Player::O
+                                                 : ConnectFourState::Player::X;
+    const std::uint64_t PLAYABLE = STATE.playableCells();
+
+    if (STATE.winningCells(CURRENT) & PLAYABLE) {
+        winner = CURRENT;
+        return true;
+    }
+
+    const std::uint64_t OTHER_WINS = STATE.winningCells(OTHER);
+    const std::uint64_t OTHER_THREATS = OTHER_WINS & PLAYABLE;
+    if ((OTHER_THREATS & (OTHER_THREATS - 1)) ||
+        (OTHER_THREATS & (OTHER_WINS >> 1))) {
+        winner = OTHER;
+        return true;
+    }
+
+    if (!STATE.canStillConnect(CURRENT) && !STATE.canStillConnect(OTHER)) {
+        winner = ConnectFourState::Player::None;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Get the winner of a finished playthrough, or of one whose result is
+ * settled when early termination is on.
+ */
+bool pMCTS_PlaythroughOver(const ConnectFourState& STATE,
+                           ConnectFourState::Player& winner) {
+    if (STATE.isOver()) {
+        winner = STATE.firstWinner();
+        return true;
+    }
+    return pMCTS_EarlyTermination() && pMCTS_SettledResult(STATE, winner);
+}
+
+/**
+ * At the end of a playthrough from START_STATE, set MOVER_CELLS, if it is
+ * given, to the cells of the player that moved into START_STATE.
+ */
+void pMCTS_RecordMoverCells(const ConnectFourState& START_STATE,
+                            const ConnectFourState& STATE,
+                            std::uint64_t* moverCells) {
+    if (moverCells != nullptr) {
+        *moverCells = STATE.playerMask(
+            (START_STATE.currentPlayer() == ConnectFourState::Player::X)
+                ? ConnectFourState::Player::O
+                : ConnectFourState::Player::X);
+    }
+}
+
+ConnectFourState::Player pMCTS_RandomPlaythrough(
+    const ConnectFourState& START_STATE,
+    std::uint64_t* moverCells = nullptr) {
     ConnectFourState runningState(START_STATE);
+    ConnectFourState::Player winner;
 
-    while (!runningState.isOver()) {
+    while (!pMCTS_PlaythroughOver(runningState, winner)) {
         const std::vector<int> LEGAL_COLUMNS = runningState.legalMoves();
-        int randomColumn = LEGAL_COLUMNS[rand() % LEGAL_COLUMNS.size()];
+        int randomColumn = LEGAL_COLUMNS[randomInt() % LEGAL_COLUMNS.size()];
         runningState.playColumn(randomColumn);
     }
 
-    return runningState;
+    pMCTS_RecordMoverCells(START_STATE, runningState, moverCells);
+    return winner;
 }
 
-ConnectFourState pMCTS_HeuristicPlaythrough(
-    const ConnectFourState& START_STATE) {
+ConnectFourState::Player pMCTS_HeuristicPlaythrough(
+    const ConnectFourState& START_STATE, std::uint64_t* moverCells = nullptr) {
     ConnectFourState runningState(START_STATE);
+    ConnectFourState::Player winner;
 
     // todo: remove CURRENT_PLAYER parameter because it should be dictated by
     // the playout current state
@@ -139,7 +423,7 @@ ConnectFourState pMCTS_HeuristicPlaythrough(
             - If the opponent is about to win, deny it.
      */
 
-    while (!runningState.isOver()) {
+    while (!pMCTS_PlaythroughOver(runningState, winner)) {
         int bestColumn = -1;
         ConnectFourState::Player curr = runningState.currentPlayer();
         ConnectFourState::Player other = (curr == ConnectFourState::Player::X)
@@ -165,7 +449,276 @@ ConnectFourState pMCTS_HeuristicPlaythrough(
         runningState.playColumn(bestColumn);
     }
 
-    return runningState;
+    pMCTS_RecordMoverCells(START_STATE, runningState, moverCells);
+    return winner;
+}
+
+/**
+ * Columns are sampled by the weights of their local patterns in
+ * pMCTS_PatternTable(). With the default table this is a random playthrough.
+ */
+ConnectFourState::Player pMCTS_PatternPlaythrough(
+    const ConnectFourState& START_STATE, std::uint64_t* moverCells = nullptr) {
+    const PatternTable& TABLE = pMCTS_PatternTable();
+    ConnectFourState runningState(START_STATE);
+    ConnectFourState::Player winner;
+
+    while (!pMCTS_PlaythroughOver(runningState, winner)) {
+        runningState.playColumn(TABLE.chooseColumn(runningState));
+    }
+
+    pMCTS_RecordMoverCells(START_STATE, runningState, moverCells);
+    return winner;
+}
+
+ConnectFourState::Player pMCTS_PlaythroughWinnerGeneric(
+    const ConnectFourState& START_STATE, const PlaythroughMode MODE,
+    std::uint64_t* moverCells = nullptr) {
+    switch (MODE) {
+        case PlaythroughMode::RANDOM:
+            return pMCTS_RandomPlaythrough(START_STATE, moverCells);
+        case PlaythroughMode::HEURISTIC:
+            return pMCTS_HeuristicPlaythrough(START_STATE, moverCells);
+        case PlaythroughMode::PATTERN:
+            return pMCTS_PatternPlaythrough(START_STATE, moverCells);
+        default:
+            throw std::logic_error("An unknown playthrough mode was passed.");
+    }
+}
+
+#if CPU_HAS_X86_64_V3
+/**
+ * The whole playthrough loop, with win checks and move generation inlined,
+ * compiled with the bit instructions of x86-64-v3.
+ */
+CPU_X86_64_V3_SCALAR __attribute__((flatten)) ConnectFourState::Player
+pMCTS_PlaythroughWinnerX86_64_V3(const ConnectFourState& START_STATE,
+                                 const PlaythroughMode MODE,
+                                 std::uint64_t* moverCells) {
+    return pMCTS_PlaythroughWinnerGeneric(START_STATE, MODE, moverCells);
+}
+#endif
+
+/**
+ * Play a playthrough from START_STATE and get its winner. If MOVER_CELLS is
+ * given, it is set to the cells the player that moved into START_STATE held
+ * when the playthrough ended.
+ */
+ConnectFourState::Player pMCTS_PlaythroughWinner(
+    const ConnectFourState& START_STATE, const PlaythroughMode MODE,
+    std::uint64_t* moverCells = nullptr) {
+#if CPU_HAS_X86_64_V3
+    if (cpu_Target() == CpuTarget::X86_64_V3) {
+        return pMCTS_PlaythroughWinnerX86_64_V3(START_STATE, MODE,
+                                                moverCells);
+    }
+#endif
+    return pMCTS_PlaythroughWinnerGeneric(START_STATE, MODE, moverCells);
+}
+
+/**
+ * Run playthroughs from a child state until QUOTA playthroughs are done or
+ * MAX_MILLISECONDS have passed since START (a non-positive limit means no
+ * time limit). Outcomes are tallied for the player that moved into the child
+ * state.
+ */
+PlaythroughTally pMCTS_RunPlaythroughs(
+    const ConnectFourState& CHILD_STATE, const PlaythroughMode MODE,
+    const long QUOTA, const double MAX_MILLISECONDS = 0,
+    const std::chrono::steady_clock::time_point START =
+        std::chrono::steady_clock::now()) {
+    const ConnectFourState::Player DECIDING_PLAYER =
+        (CHILD_STATE.currentPlayer() == ConnectFourState::Player::X)
+            ? ConnectFourState::Player::O
+            : ConnectFourState::Player::X;
+    PlaythroughDeadline deadline(START, MAX_MILLISECONDS / 1000);
+
+    PlaythroughTally tally;
+
+    if (CHILD_STATE.isOver() && MAX_MILLISECONDS <= 0) {
+        // The move itself ended the game, every playthrough has the same
+        // outcome. With a time limit they are counted like any other, so the
+        // limit is kept.
+        for (long i = 0; i < QUOTA; ++i) {
+            tally.record(CHILD_STATE.firstWinner(), DECIDING_PLAYER);
+        }
+        return tally;
+    }
+
+    for (long i = 0; i < QUOTA; ++i) {
+        if (MAX_MILLISECONDS > 0 && deadline.expired()) {
+            break;
+        }
+        tally.record(pMCTS_PlaythroughWinner(CHILD_STATE, MODE),
+                     DECIDING_PLAYER);
+    }
+
+    return tally;
+}
+
+/**
+ * Get prior outcomes for every column, before any playthroughs: the value
+ * network's evaluation counted as pMCTS_ValueNetworkPlaythroughs()
+ * playthroughs, plus whatever pMCTS_PositionStore() holds for the position the
+ * column leads to, scaled down to at most pMCTS_PositionStorePlaythroughs().
+ * Empty tallies when neither is available.
+ */
+std::vector<PlaythroughTally> pMCTS_PriorTallies(
+    const ConnectFourState& STATE, const std::vector<int>& COLUMNS) {
+    std::vector<PlaythroughTally> priors(COLUMNS.size());
+
+    const std::unique_ptr<ValueNetwork>& NETWORK = pMCTS_ValueNetwork();
+    if (NETWORK) {
+        const long WEIGHT = pMCTS_ValueNetworkPlaythroughs();
+        const std::vector<double> VALUES =
+            NETWORK->evaluateChildren(STATE, COLUMNS);
+        for (int i = 0; i < COLUMNS.size(); ++i) {
+            priors[i].wins = std::lround(WEIGHT * (1 + VALUES[i]) / 2);
+            priors[i].losses = WEIGHT - priors[i].wins;
+        }
+    }
+
+    const std::unique_ptr<PositionStore>& STORE = pMCTS_PositionStore();
+    if (STORE) {
+        std::vector<ConnectFourState> children;
+        for (int column : COLUMNS) {
+            children.push_back(STATE.applyMove(column));
+        }
+
+        const std::vector<PositionStatistics> STATISTICS =
+            STORE->lookup(children);
+        const long WEIGHT = pMCTS_PositionStorePlaythroughs();
+        for (int i = 0; i < COLUMNS.size(); ++i) {
+            const PositionStatistics& STORED = STATISTICS[i];
+            const std::uint64_t COUNT =
+                STORED.wins + STORED.losses + STORED.draws;
+            if (COUNT <= static_cast<std::uint64_t>(WEIGHT)) {
+                priors[i].wins += STORED.wins;
+                priors[i].losses += STORED.losses;
+                priors[i].draws += STORED.draws;
+                continue;
+            }
+            const double SCALE = static_cast<double>(WEIGHT) / COUNT;
+            const long WINS = std::lround(STORED.wins * SCALE);
+            const long LOSSES =
+                std::min(WEIGHT - WINS, std::lround(STORED.losses * SCALE));
+            priors[i].wins += WINS;
+            priors[i].losses += LOSSES;
+            priors[i].draws += WEIGHT - WINS - LOSSES;
+        }
+    }
+
+    return priors;
+}
+
+/**
+ * Add the playthrough outcomes of a decision to pMCTS_PositionStore(), if one
+ * is open.
+ */
+void pMCTS_StoreTallies(const ConnectFourState& STATE,
+                        const std::vector<int>& COLUMNS,
+                        const std::vector<PlaythroughTally>& TALLIES) {
+    const std::unique_ptr<PositionStore>& STORE = pMCTS_PositionStore();
+    if (!STORE) {
+        return;
+    }
+
+    std::vector<ConnectFourState> children;
+    std::vector<PositionStatistics> statistics;
+    for (int i = 0; i < COLUMNS.size(); ++i) {
+        children.push_back(STATE.applyMove(COLUMNS[i]));
+        PositionStatistics current;
+        current.visits = TALLIES[i].playthroughs();
+        current.wins = TALLIES[i].wins;
+        current.losses = TALLIES[i].losses;
+        current.draws = TALLIES[i].draws;
+        statistics.push_back(current);
+    }
+    STORE->add(children, statistics);
+}
+
+/**
+ * Whether decisions record hardware counters.
+ */
+bool& pMCTS_Profiling() {
+    static bool profiling = false;
+    return profiling;
+}
+
+/**
+ * Whether decisions blend in all-moves-as-first (AMAF) statistics, where a
+ * playthrough counts for every column whose next cell the deciding player
+ * ended up holding, not just for the column it started with. A column with n
+ * playthroughs gives its AMAF average the weight sqrt(k / (3n + k)), with
+ * k = pMCTS_RaveEquivalence(), so it guides early choices and fades as the
+ * column's own playthroughs accumulate.
+ */
+bool& pMCTS_Rave() {
+    static bool rave = false;
+    return rave;
+}
+
+double& pMCTS_RaveEquivalence() {
+    static double equivalence = 300;
+    return equivalence;
+}
+
+/**
+ * Run the proof search for a decision, when enabled. Under a time cutoff it
+ * may use at most half of the time, leaving the rest for playthroughs.
+ */
+ProofResult pMCTS_Prove(const ConnectFourState& STATE,
+                        const bool CUTOFF_ON_TIME,
+                        const std::chrono::steady_clock::time_point START_TIME,
+                        const double MAX_SECONDS) {
+    ProofResult proof;
+    if (pMCTS_ProofNodes() > 0) {
+        const std::chrono::steady_clock::time_point DEADLINE =
+            CUTOFF_ON_TIME
+                ? START_TIME +
+                      std::chrono::duration_cast<
+                          std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(MAX_SECONDS / 2))
+                : std::chrono::steady_clock::time_point::max();
+        proof = pMCTS_ProofSearch().prove(STATE, pMCTS_ProofNodes(), DEADLINE);
+    }
+    return proof;
+}
+
+/**
+ * Get the decision to play a column proven to win, without playthroughs.
+ */
+Decision pMCTS_ProvenWinDecision(
+    const ConnectFourState& STATE, const PlaythroughMode MODE,
+    const double MAX_SECONDS, const DecisionCutoff CUTOFF,
+    const std::chrono::steady_clock::time_point START_TIME,
+    const ProofResult& PROOF) {
+    const double SECONDS = millisecondsSince(START_TIME) / 1000;
+    Decision decision(STATE.currentPlayer(), MODE, CUTOFF, PROOF.column,
+                      STATE.legalMoves().size(), 0, 0, SECONDS);
+    decision.proof = ProofOutcome::WIN;
+    decision.proofNodes = PROOF.nodes;
+    if (CUTOFF == DecisionCutoff::TIME) {
+        decision.overshoot = std::max(0.0, SECONDS - MAX_SECONDS);
+    }
+    return decision;
+}
+
+/**
+ * Get the legal columns worth playthroughs: those not proven to lose, or
+ * every column when the position is lost anyway.
+ */
+std::vector<int> pMCTS_UnprovenColumns(const ConnectFourState& STATE,
+                                       const ProofResult& PROOF) {
+    std::vector<int> columns;
+    for (int column : STATE.legalMoves()) {
+        if (PROOF.outcome == ProofOutcome::LOSS ||
+            !std::binary_search(PROOF.losingColumns.begin(),
+                                PROOF.losingColumns.end(), column)) {
+            columns.push_back(column);
+        }
+    }
+    return columns;
 }
 
 Decision pMCTS_DecideColumn(const ConnectFourState& STATE,
@@ -173,83 +726,222 @@ Decision pMCTS_DecideColumn(const ConnectFourState& STATE,
                             const double MAX_SECONDS = 5.0,
                             const DecisionCutoff CUTOFF = DecisionCutoff::TIME,
                             const long MINIMUM_ITERATIONS = 20000,
-                            const bool PRINT_STATISTICS = false) {
+                            const bool PRINT_STATISTICS = false,
+                            const RootAllocation ALLOCATION =
+                                RootAllocation::ROUND_ROBIN) {
     if (STATE.isOver()) {
         throw std::runtime_error(
             "The game cannot be played further. (It is in a draw.)");
     }
 
-    if (MAX_SECONDS < 0.1) {
-        throw std::invalid_argument(
-            "The maximum time must be at least 0.1 seconds.");
+    const bool CUTOFF_ON_TIME = CUTOFF == DecisionCutoff::TIME;
+    if (CUTOFF_ON_TIME && !(MAX_SECONDS > 0)) {
+        throw std::invalid_argument("The maximum time must be positive.");
     }
 
+    PerfPhases phases(pMCTS_Profiling());
+
     const ConnectFourState::Player DECIDING_PLAYER = STATE.currentPlayer();
-    const ConnectFourState::Player OTHER_PLAYER =
-        (ConnectFourState::Player::X == DECIDING_PLAYER)
-            ? ConnectFourState::Player::O
-            : ConnectFourState::Player::X;
-    const double MAX_MILLISECONDS = MAX_SECONDS * 1000;
-    const bool CUTOFF_ON_TIME = CUTOFF == DecisionCutoff::TIME;
+    const std::chrono::steady_clock::time_point START_TIME =
+        std::chrono::steady_clock::now();
+
+    // A forced win found by proof search is played without playthroughs, and
+    // columns proven to lose are not considered unless they all are.
+    const ProofResult PROOF =
+        pMCTS_Prove(STATE, CUTOFF_ON_TIME, START_TIME, MAX_SECONDS);
+    phases.mark("proof");
+
+    if (PROOF.outcome == ProofOutcome::WIN) {
+        Decision decision = pMCTS_ProvenWinDecision(
+            STATE, MODE, MAX_SECONDS, CUTOFF, START_TIME, PROOF);
+        decision.profile = phases.profile();
+        return decision;
+    }
+
+    const std::vector<int> COLUMNS = pMCTS_UnprovenColumns(STATE, PROOF);
 
-    std::vector<std::pair<int, std::pair<ConnectFourState, int>>> childStates;
-    for (int playableColumn : STATE.legalMoves()) {
-        childStates.push_back(
-            {playableColumn, {STATE.applyMove(playableColumn), 0}});
+    std::vector<std::pair<int, std::pair<ConnectFourState, PlaythroughTally>>>
+        childStates;
+    for (int playableColumn : COLUMNS) {
+        childStates.push_back({playableColumn,
+                               {STATE.applyMove(playableColumn),
+                                PlaythroughTally()}});
     }
     childStates.shrink_to_fit();
 
-    const std::chrono::high_resolution_clock::time_point START_TIME =
-        std::chrono::high_resolution_clock::now();
+    PlaythroughDeadline deadline(START_TIME, MAX_SECONDS);
+
+    const std::vector<PlaythroughTally> PRIORS =
+        pMCTS_PriorTallies(STATE, COLUMNS);
+    phases.mark("setup");
 
+    const int CHILDREN = childStates.size();
+    // Bandit allocations spend the same total as round robin would.
+    const long BUDGET = MINIMUM_ITERATIONS * CHILDREN;
     long playthroughs = 0;
 
-    for (long iteration = 0;
-         (CUTOFF_ON_TIME &&
-          (millisecondsSince(START_TIME) <= MAX_MILLISECONDS)) ||
-         (!CUTOFF_ON_TIME && (iteration < MINIMUM_ITERATIONS));
-         ++iteration) {
-        for (int i = 0; i < childStates.size(); ++i) {
-            const int CURRENT_COLUMN = childStates[i].first;
-            const ConnectFourState& CURRENT_CHILD_STATE =
-                childStates[i].second.first;
-            int& currentColumnScore = childStates[i].second.second;
-
-            const ConnectFourState::Player FIRST_WINNER =
-                (MODE == PlaythroughMode::RANDOM)
-                    ? pMCTS_RandomPlaythrough(CURRENT_CHILD_STATE).firstWinner()
-                    : pMCTS_HeuristicPlaythrough(CURRENT_CHILD_STATE)
-                          .firstWinner();
-
-            if (FIRST_WINNER == DECIDING_PLAYER) {
-                currentColumnScore += 1;
-            } else if (FIRST_WINNER == OTHER_PLAYER) {
-                currentColumnScore += -1;
+    const bool RAVE = pMCTS_Rave();
+    const double EQUIVALENCE = pMCTS_RaveEquivalence();
+    std::vector<PlaythroughTally> amaf(CHILDREN);
+    // The cell each column's piece lands in.
+    std::vector<std::uint64_t> childCells;
+    for (const auto& CHILD : childStates) {
+        childCells.push_back(CHILD.second.first.playerMask(DECIDING_PLAYER) ^
+                             STATE.playerMask(DECIDING_PLAYER));
+    }
+
+    const auto playChild = [&](int i) {
+        std::uint64_t moverCells = 0;
+        const ConnectFourState::Player WINNER = pMCTS_PlaythroughWinner(
+            childStates[i].second.first, MODE, RAVE ? &moverCells : nullptr);
+        childStates[i].second.second.record(WINNER, DECIDING_PLAYER);
+        if (RAVE) {
+            for (int j = 0; j < CHILDREN; ++j) {
+                if (moverCells & childCells[j]) {
+                    amaf[j].record(WINNER, DECIDING_PLAYER);
+                }
+            }
+        }
+        ++playthroughs;
+    };
+
+    const auto combined = [&](int i) -> PlaythroughTally {
+        PlaythroughTally tally = PRIORS[i];
+        tally.merge(childStates[i].second.second);
+        return tally;
+    };
+
+    // Expected reward of a column, with the AMAF average blended in when
+    // enabled.
+    const auto value = [&](int i) -> double {
+        const PlaythroughTally TALLY = combined(i);
+        if (!RAVE || EQUIVALENCE <= 0) {
+            return TALLY.mean();
+        }
+        const double WEIGHT = std::sqrt(
+            EQUIVALENCE / (3.0 * TALLY.playthroughs() + EQUIVALENCE));
+        return (1 - WEIGHT) * TALLY.mean() + WEIGHT * amaf[i].mean();
+    };
+
+    if (ALLOCATION == RootAllocation::ROUND_ROBIN) {
+        if (CUTOFF_ON_TIME) {
+            // Columns are compared by average, so the last round can stop
+            // part way. It starts at a random column so no column is always
+            // the one with a playthrough more.
+            for (int i = randomInt() % CHILDREN; !deadline.expired();
+                 i = (i + 1) % CHILDREN) {
+                playChild(i);
+            }
+        } else {
+            for (long iteration = 0; iteration < MINIMUM_ITERATIONS;
+                 ++iteration) {
+                for (int i = 0; i < CHILDREN; ++i) {
+                    playChild(i);
+                }
+            }
+        }
+    } else if (ALLOCATION == RootAllocation::UCB1) {
+        const double EXPLORATION = std::sqrt(2.0);
+
+        for (long step = 0;; ++step) {
+            if (CUTOFF_ON_TIME ? deadline.expired() : (step >= BUDGET)) {
+                break;
+            }
+
+            long visits = 0;
+            for (int i = 0; i < CHILDREN; ++i) {
+                visits += combined(i).playthroughs();
+            }
+
+            int chosen = -1;
+            double bestBound = -1;
+            for (int i = 0; i < CHILDREN; ++i) {
+                const PlaythroughTally TALLY = combined(i);
+                if (TALLY.playthroughs() == 0) {
+                    chosen = i;
+                    break;
+                }
+                const double BOUND =
+                    value(i) + EXPLORATION * std::sqrt(std::log(visits) /
+                                                       TALLY.playthroughs());
+                if (BOUND > bestBound) {
+                    chosen = i;
+                    bestBound = BOUND;
+                }
+            }
+
+            playChild(chosen);
+        }
+    } else {
+        std::vector<int> survivors;
+        for (int i = 0; i < CHILDREN; ++i) {
+            survivors.push_back(i);
+        }
+
+        int rounds = 1;
+        while ((1 << rounds) < CHILDREN) {
+            ++rounds;
+        }
+
+        for (int round = 0; round < rounds; ++round) {
+            if (CUTOFF_ON_TIME) {
+                PlaythroughDeadline roundDeadline(
+                    START_TIME, MAX_SECONDS * (round + 1) / rounds);
+                for (int j = 0; !roundDeadline.expired();
+                     j = (j + 1) % survivors.size()) {
+                    playChild(survivors[j]);
+                }
             } else {
-                currentColumnScore += 1;
+                const long PER_CHILD = std::max(
+                    1L, BUDGET / static_cast<long>(survivors.size() * rounds));
+                for (long j = 0; j < PER_CHILD; ++j) {
+                    for (int i : survivors) {
+                        playChild(i);
+                    }
+                }
             }
 
-            ++playthroughs;
+            std::stable_sort(survivors.begin(), survivors.end(),
+                             [&](int a, int b) {
+                                 return value(a) > value(b);
+                             });
+            survivors.resize((survivors.size() + 1) / 2);
         }
     }
 
-    const long double MS_TIME_SPENT =
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::high_resolution_clock::now() - START_TIME)
-            .count();
+    phases.mark("playthroughs");
 
     int bestColumn = -1;
     int bestScore = INT_MIN;
+    double bestValue = -1;
+    int ties = 0;
 
-    for (int i = 0; i < childStates.size(); ++i) {
+    for (int i = 0; i < CHILDREN; ++i) {
         const int COLUMN = childStates[i].first;
-        const int SCORE = childStates[i].second.second;
-        if (SCORE > bestScore || (SCORE == bestScore && (rand() % 2 == 0))) {
+        const int SCORE = combined(i).score();
+        const double VALUE = value(i);
+
+        // Averages, not totals: priors and bandit allocations leave columns
+        // with different numbers of playthroughs. With equal numbers the mean
+        // orders columns exactly as the score. Ties are broken uniformly.
+        if (VALUE > bestValue) {
+            ties = 0;
+        }
+        if (VALUE >= bestValue && randomInt() % ++ties == 0) {
             bestColumn = COLUMN;
             bestScore = SCORE;
+            bestValue = VALUE;
         }
     }
 
+    std::vector<PlaythroughTally> tallies;
+    for (const auto& CHILD : childStates) {
+        tallies.push_back(CHILD.second.second);
+    }
+    pMCTS_StoreTallies(STATE, COLUMNS, tallies);
+    phases.mark("selection");
+    const long double MS_TIME_SPENT = millisecondsSince(START_TIME);
+
     if (PRINT_STATISTICS) {
         std::cout << "========================================\n";
         std::cout << "Playthroughs:     " << playthroughs << '\n'
@@ -259,10 +951,26 @@ Decision pMCTS_DecideColumn(const ConnectFourState& STATE,
                   << '\n'
                   << "Time:             " << (MS_TIME_SPENT / 1000) << "s"
                   << '\n';
+        if (pMCTS_Profiling()) {
+            std::cout << "Counters:         "
+                      << phases.profile().front().second.toJSON() << '\n';
+        }
         std::cout << "========================================\n";
     }
 
-    return Decision(DECIDING_PLAYER, MODE, CUTOFF, bestColumn,
-                    childStates.size(), bestScore, playthroughs,
-                    MS_TIME_SPENT / 1000);
+    Decision decision(DECIDING_PLAYER, MODE, CUTOFF, bestColumn,
+                      childStates.size(), bestScore, playthroughs,
+                      MS_TIME_SPENT / 1000);
+    decision.profile = phases.profile();
+    decision.proof = PROOF.outcome;
+    decision.proofNodes = PROOF.nodes;
+    if (CUTOFF_ON_TIME) {
+        decision.overshoot =
+            std::max(0.0, static_cast<double>(MS_TIME_SPENT / 1000) -
+                              MAX_SECONDS);
+    }
+    for (int i = 0; i < CHILDREN; ++i) {
+        decision.columns.push_back({COLUMNS[i], tallies[i]});
+    }
+    return decision;
 }
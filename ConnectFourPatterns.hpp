@@ -0,0 +1,199 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourState.hpp"
+#include "Random.hpp"
+
+/**
+ * Pattern-weighted playthrough policy.
+ *
+ * Every legal column is described by the 3x3 neighbourhood around the cell a
+ * piece dropped into it would land in. Each of the 8 neighbours is encoded as
+ * empty, own piece, opponent piece or off the board (2 bits each), giving a
+ * 16-bit index into a table of weights. Patterns are read straight from the
+ * bitboards, and a column is sampled with probability proportional to the
+ * weight of its pattern by a scan of the cumulative weights, which for at
+ * most 7 columns is cheaper than building any sampling table per ply.
+ *
+ * Weight files are plain text, one "<pattern> <weight>" pair per line. Patterns
+ * not listed keep a weight of 1, so an empty file gives uniform random
+ * playthroughs.
+ *
+ * Citations
+ *
+ *  https://www.remi-coulom.fr/Amsterdam2007/
+ *      Pattern weights for Monte-Carlo playouts.
+ */
+
+const int PATTERN_NEIGHBOURS = 8;
+const int PATTERN_COUNT = 1 << (2 * PATTERN_NEIGHBOURS);
+
+class PatternTable {
+   public:
+    PatternTable();
+
+    static int patternAt(const ConnectFourState& state, int column);
+
+    double weight(int pattern) const;
+    void setWeight(int pattern, double weight);
+    int chooseColumn(const ConnectFourState& state) const;
+
+    void load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+   private:
+    std::vector<double> _weights;
+
+    static std::uint64_t _padded(std::uint64_t pieces);
+    static int _patternAt(std::uint64_t own, std::uint64_t opponent, int cell);
+};
+
+PatternTable::PatternTable() : _weights(PATTERN_COUNT, 1.0) {}
+
+/**
+ * Get the pattern around the cell a piece played in the column would land
+ * in, seen from the player to move.
+ */
+int PatternTable::patternAt(const ConnectFourState& state, int column) {
+    const std::uint64_t OWN = state.playerMask(state.currentPlayer());
+    const std::uint64_t OPPONENT =
+        (state.playerMask(ConnectFourState::Player::X) |
+         state.playerMask(ConnectFourState::Player::O)) ^
+        OWN;
+    const int CELL = column * 7 + 5 - state.playableRow(column);
+    return _patternAt(_padded(OWN), _padded(OPPONENT), CELL);
+}
+
+/**
+ * Shift a bitboard up 8 bits, so every neighbour of a cell has a bit, and
+ * mark every cell off the board. Off the board cells then read as both
+ * players' pieces, which is their pattern code.
+ */
+std::uint64_t PatternTable::_padded(std::uint64_t pieces) {
+    // One bit per cell: 6 of every 7 bits, for 7 columns.
+    const std::uint64_t BOARD = 0x3FULL * (((1ULL << 49) - 1) / 127);
+    return (pieces << 8) | ~(BOARD << 8);
+}
+
+/**
+ * Get the pattern around CELL, a bit index in the layout of
+ * ConnectFourState::playerMask(), from boards padded by _padded().
+ */
+int PatternTable::_patternAt(std::uint64_t own, std::uint64_t opponent,
+                             int cell) {
+    // Neighbour bits relative to the cell, in pattern order: the row above,
+    // the same row and the row below, left to right.
+    const int OFFSETS[PATTERN_NEIGHBOURS] = {-6, 1, 8, -7, 7, -8, -1, 6};
+    int pattern = 0;
+    for (int i = 0; i < PATTERN_NEIGHBOURS; ++i) {
+        const int BIT = 8 + OFFSETS[i];
+        pattern |= (((own >> (cell + BIT)) & 1) |
+                    (((opponent >> (cell + BIT)) & 1) << 1))
+                   << (2 * i);
+    }
+    return pattern;
+}
+
+double PatternTable::weight(int pattern) const { return _weights[pattern]; }
+
+void PatternTable::setWeight(int pattern, double weight) {
+    if (pattern < 0 || pattern >= PATTERN_COUNT || !(weight >= 0)) {
+        throw std::invalid_argument("Pattern " + std::to_string(pattern) +
+                                    " cannot have weight " +
+                                    std::to_string(weight) + ".");
+    }
+    _weights[pattern] = weight;
+}
+
+/**
+ * Sample a legal column in proportion to the weights of the patterns, or
+ * uniformly when they are all 0.
+ */
+int PatternTable::chooseColumn(const ConnectFourState& state) const {
+    const std::uint64_t OWN = state.playerMask(state.currentPlayer());
+    const std::uint64_t OPPONENT =
+        (state.playerMask(ConnectFourState::Player::X) |
+         state.playerMask(ConnectFourState::Player::O)) ^
+        OWN;
+    const std::uint64_t PADDED_OWN = _padded(OWN);
+    const std::uint64_t PADDED_OPPONENT = _padded(OPPONENT);
+
+    int cells[7];
+    double cumulative[7];
+    int outcomes = 0;
+    double total = 0;
+
+    for (std::uint64_t playable = state.playableCells(); playable != 0;
+         playable &= playable - 1) {
+        const int CELL = __builtin_ctzll(playable);
+        total += _weights[_patternAt(PADDED_OWN, PADDED_OPPONENT, CELL)];
+        cells[outcomes] = CELL;
+        cumulative[outcomes] = total;
+        ++outcomes;
+    }
+
+    if (!(total > 0)) {
+        return cells[randomInt() % outcomes] / 7;
+    }
+
+    const double TARGET = randomInt() / (RANDOM_MAX + 1.0) * total;
+    int chosen = 0;
+    while (chosen < outcomes - 1 && cumulative[chosen] <= TARGET) {
+        ++chosen;
+    }
+    return cells[chosen] / 7;
+}
+
+void PatternTable::load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (file.fail()) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    std::vector<double> loaded(PATTERN_COUNT, 1.0);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream tokens(line);
+        int pattern;
+        double weight;
+        if (!(tokens >> pattern >> weight) || pattern < 0 ||
+            pattern >= PATTERN_COUNT || !(weight >= 0)) {
+            throw std::runtime_error("\'" + filename + "\' line " +
+                                     std::to_string(lineNumber) +
+                                     " is not a pattern weight.");
+        }
+        loaded[pattern] = weight;
+    }
+    _weights = loaded;
+}
+
+void PatternTable::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ofstream::trunc);
+    if (file.fail()) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+    file << "# pattern weight\n";
+    for (int pattern = 0; pattern < PATTERN_COUNT; ++pattern) {
+        if (_weights[pattern] != 1.0) {
+            file << pattern << ' ' << _weights[pattern] << '\n';
+        }
+    }
+}
+
+/**
+ * The table used by pattern playthroughs.
+ */
+PatternTable& pMCTS_PatternTable() {
+    static PatternTable table;
+    return table;
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "ConnectFourState.hpp"
+
+/**
+ * Perft: count the positions reachable at each depth from the empty board,
+ * as a correctness check of playColumn, legalMoves and win detection, and as
+ * a move generation benchmark.
+ *
+ * Won and drawn positions are counted but not expanded. Without
+ * deduplication the counts are game tree leaves. With deduplication each
+ * board is counted once per depth and expanded once, and the counts must
+ * match the published numbers of Connect 4 positions.
+ *
+ * Subtrees below a small split depth are shared out between threads.
+ *
+ * Citations
+ *
+ *  https://oeis.org/A212693
+ *      Number of legal Connect 4 positions after n plies.
+ *
+ *  https://www.chessprogramming.org/Perft
+ */
+
+const std::vector<std::uint64_t> PERFT_PUBLISHED_POSITIONS = {
+    1ULL,            7ULL,            49ULL,           238ULL,
+    1120ULL,         4263ULL,         16422ULL,        54859ULL,
+    184275ULL,       558186ULL,       1662623ULL,      4568683ULL,
+    12236101ULL,     30929111ULL,     75437595ULL,     176541259ULL,
+    394591391ULL,    858218743ULL,    1763883894ULL,   3568259802ULL,
+    6746155945ULL,   12673345045ULL,  22010823988ULL,  38263228189ULL,
+    60830813459ULL,  97266114959ULL,  140728569039ULL, 205289508055ULL,
+    268057611944ULL, 352626845666ULL, 410378505447ULL, 479206477733ULL,
+    488906447183ULL, 496636890702ULL, 433471730336ULL, 370947887723ULL,
+    266313901222ULL, 183615682381ULL, 104004465349ULL, 55156010773ULL,
+    22695896495ULL,  7811825938ULL,   1459332899ULL};
+
+struct PerftResult {
+    std::vector<std::uint64_t> positions;
+    std::uint64_t nodes = 0;
+    double seconds = 0;
+};
+
+/**
+ * Position keys seen at one depth, split into shards so threads rarely wait
+ * on each other.
+ */
+class PerftSeenSet {
+   public:
+    bool insert(std::uint64_t key);
+    std::uint64_t size() const;
+
+   private:
+    static const int _SHARDS = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<std::uint64_t> keys;
+    };
+
+    std::array<Shard, _SHARDS> _shards;
+};
+
+/**
+ * Returns true if the key was not seen before.
+ */
+bool PerftSeenSet::insert(std::uint64_t key) {
+    Shard& shard = _shards[(key * 0x9e3779b97f4a7c15ULL) >> 58];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    return shard.keys.insert(key).second;
+}
+
+std::uint64_t PerftSeenSet::size() const {
+    std::uint64_t total = 0;
+    for (const Shard& shard : _shards) {
+        total += shard.keys.size();
+    }
+    return total;
+}
+
+/**
+ * Count positions below STATE, which is at depth DEPTH, into COUNTS.
+ */
+void perft_Expand(const ConnectFourState& STATE, int depth, int maxDepth,
+                  std::vector<std::uint64_t>& counts, std::uint64_t& nodes,
+                  std::vector<PerftSeenSet>* seen) {
+    if (seen != nullptr && !(*seen)[depth].insert(STATE.positionKey())) {
+        return;
+    }
+    ++counts[depth];
+
+    if (depth == maxDepth || STATE.isOver()) {
+        return;
+    }
+
+    for (int column : STATE.legalMoves()) {
+        ConnectFourState child(STATE);
+        child.playColumn(column);
+        ++nodes;
+        perft_Expand(child, depth + 1, maxDepth, counts, nodes, seen);
+    }
+}
+
+PerftResult perft(int maxDepth, bool deduplicate = false,
+                  int threads = std::thread::hardware_concurrency()) {
+    const int SPLIT_DEPTH = std::min(maxDepth, 3);
+    threads = std::max(threads, 1);
+
+    const std::chrono::steady_clock::time_point START_TIME =
+        std::chrono::steady_clock::now();
+
+    PerftResult result;
+    result.positions.assign(maxDepth + 1, 0);
+    std::vector<PerftSeenSet> seen(deduplicate ? maxDepth + 1 : 0);
+    std::vector<PerftSeenSet>* seenPointer = deduplicate ? &seen : nullptr;
+
+    // Build the frontier breadth first, counting the shallow depths on the
+    // way.
+    std::vector<ConnectFourState> frontier = {ConnectFourState()};
+    for (int depth = 0; depth < SPLIT_DEPTH; ++depth) {
+        std::vector<ConnectFourState> next;
+        for (const ConnectFourState& state : frontier) {
+            if (deduplicate && !seen[depth].insert(state.positionKey())) {
+                continue;
+            }
+            ++result.positions[depth];
+            if (state.isOver()) {
+                continue;
+            }
+            for (int column : state.legalMoves()) {
+                next.push_back(state.applyMove(column));
+                ++result.nodes;
+            }
+        }
+        frontier.swap(next);
+    }
+
+    std::atomic<size_t> nextIndex(0);
+    std::mutex resultMutex;
+
+    const auto work = [&]() {
+        std::vector<std::uint64_t> counts(maxDepth + 1, 0);
+        std::uint64_t nodes = 0;
+        for (size_t i = nextIndex++; i < frontier.size(); i = nextIndex++) {
+            perft_Expand(frontier[i], SPLIT_DEPTH, maxDepth, counts, nodes,
+                         seenPointer);
+        }
+
+        std::lock_guard<std::mutex> guard(resultMutex);
+        for (int depth = 0; depth <= maxDepth; ++depth) {
+            result.positions[depth] += counts[depth];
+        }
+        result.nodes += nodes;
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - START_TIME)
+                         .count();
+    return result;
+}
+
+/**
+ * Run perft and print the counts per depth. Returns false if a deduplicated
+ * count does not match the published count.
+ */
+bool perft_Report(int maxDepth, bool deduplicate, int threads) {
+    const PerftResult RESULT = perft(maxDepth, deduplicate, threads);
+    bool matches = true;
+
+    std::cout << "depth,positions" << (deduplicate ? ",published,match" : "")
+              << '\n';
+    for (int depth = 0; depth <= maxDepth; ++depth) {
+        std::cout << depth << ',' << RESULT.positions[depth];
+        if (deduplicate && depth < PERFT_PUBLISHED_POSITIONS.size()) {
+            const bool MATCH =
+                RESULT.positions[depth] == PERFT_PUBLISHED_POSITIONS[depth];
+            matches = matches && MATCH;
+            std::cout << ',' << PERFT_PUBLISHED_POSITIONS[depth] << ','
+                      << (MATCH ? "yes" : "NO");
+        }
+        std::cout << '\n';
+    }
+
+    std::cout << "Threads:   " << threads << '\n'
+              << "Nodes:     " << RESULT.nodes << '\n'
+              << "Time:      " << RESULT.seconds << "s\n"
+              << "Nodes/sec: " << std::fixed << std::setprecision(0)
+              << (RESULT.nodes / RESULT.seconds) << '\n';
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout.precision(6);
+    return matches;
+}
@@ -0,0 +1,293 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourState.hpp"
+
+/**
+ * Persistent position statistics, kept in a memory-mapped file so they
+ * survive between processes and can be shared by several processes on one
+ * host.
+ *
+ * The file is a fixed size open addressing hash table with linear probing. A
+ * position is identified exactly by its X and O bitboards. Counts are from
+ * the point of view of the player that moved into the position.
+ *
+ * When a position is not found within PROBE_LIMIT slots and none of them is
+ * empty, the slot with the fewest visits is evicted, so the file never grows
+ * past the capacity it was created with.
+ *
+ * Readers take a shared flock() and writers an exclusive one, so processes
+ * sharing a file see whole updates. Opening a file only maps it.
+ *
+ * Citations
+ *
+ *  https://man7.org/linux/man-pages/man2/mmap.2.html
+ *  https://man7.org/linux/man-pages/man2/flock.2.html
+ *
+ *  https://prng.di.unimi.it/splitmix64.c
+ *      Mixing function for the position hash.
+ */
+
+struct PositionStatistics {
+    std::uint64_t visits = 0;
+    std::uint64_t wins = 0;
+    std::uint64_t losses = 0;
+    std::uint64_t draws = 0;
+};
+
+class PositionStore {
+   public:
+    static const int PROBE_LIMIT = 16;
+
+    PositionStore(const std::string& filename, std::uint64_t capacity = 1 << 20);
+    ~PositionStore();
+
+    PositionStore(const PositionStore&) = delete;
+    PositionStore& operator=(const PositionStore&) = delete;
+
+    std::uint64_t capacity() const;
+    std::uint64_t size() const;
+
+    std::vector<PositionStatistics> lookup(
+        const std::vector<ConnectFourState>& states) const;
+    void add(const std::vector<ConnectFourState>& states,
+             const std::vector<PositionStatistics>& statistics);
+
+   private:
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t capacity;
+        std::uint64_t size;
+        std::uint64_t reserved[5];
+    };
+
+    struct Entry {
+        std::uint64_t xKey;
+        std::uint64_t oMask;
+        PositionStatistics statistics;
+    };
+
+    // Never part of a board, marks a slot as used.
+    static const std::uint64_t _OCCUPIED = std::uint64_t(1) << 63;
+    static const std::uint32_t _VERSION = 1;
+
+    const std::string _FILENAME;
+    int _fd;
+    size_t _mappedBytes;
+    Header* _header;
+    Entry* _entries;
+    mutable std::mutex _mutex;
+
+    static std::uint64_t _hash(std::uint64_t xMask, std::uint64_t oMask);
+    const Entry* _find(std::uint64_t xMask, std::uint64_t oMask) const;
+    Entry* _findOrInsert(std::uint64_t xMask, std::uint64_t oMask);
+};
+
+PositionStore::PositionStore(const std::string& filename,
+                             std::uint64_t capacity)
+    : _FILENAME(filename), _fd(-1), _mappedBytes(0), _header(nullptr),
+      _entries(nullptr) {
+    // Round up to a power of two so probing can mask instead of divide.
+    std::uint64_t roundedCapacity = PROBE_LIMIT;
+    while (roundedCapacity < capacity) {
+        roundedCapacity <<= 1;
+    }
+
+    _fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    // Whoever creates the file initializes it while holding the lock.
+    flock(_fd, LOCK_EX);
+    struct stat status;
+    fstat(_fd, &status);
+
+    if (status.st_size == 0) {
+        const size_t BYTES = sizeof(Header) + roundedCapacity * sizeof(Entry);
+        if (ftruncate(_fd, BYTES) < 0) {
+            flock(_fd, LOCK_UN);
+            close(_fd);
+            throw std::runtime_error("\'" + filename +
+                                     "\' could not be resized.");
+        }
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "C4ST", 4);
+        header.version = _VERSION;
+        header.capacity = roundedCapacity;
+        if (pwrite(_fd, &header, sizeof(header), 0) !=
+            static_cast<ssize_t>(sizeof(header))) {
+            flock(_fd, LOCK_UN);
+            close(_fd);
+            throw std::runtime_error("\'" + filename +
+                                     "\' could not be written.");
+        }
+        status.st_size = BYTES;
+    }
+    flock(_fd, LOCK_UN);
+
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, _fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(_fd);
+        throw std::runtime_error("\'" + filename + "\' could not be mapped.");
+    }
+
+    _mappedBytes = status.st_size;
+    _header = static_cast<Header*>(mapping);
+    _entries = reinterpret_cast<Entry*>(_header + 1);
+
+    if (std::memcmp(_header->magic, "C4ST", 4) != 0 ||
+        _header->version != _VERSION ||
+        sizeof(Header) + _header->capacity * sizeof(Entry) != _mappedBytes) {
+        munmap(mapping, _mappedBytes);
+        close(_fd);
+        throw std::runtime_error("\'" + filename +
+                                 "\' is not a position store.");
+    }
+}
+
+PositionStore::~PositionStore() {
+    munmap(_header, _mappedBytes);
+    close(_fd);
+}
+
+std::uint64_t PositionStore::capacity() const { return _header->capacity; }
+
+std::uint64_t PositionStore::size() const { return _header->size; }
+
+std::uint64_t PositionStore::_hash(std::uint64_t xMask, std::uint64_t oMask) {
+    std::uint64_t hash = xMask * 0x9e3779b97f4a7c15ULL ^ oMask;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+const PositionStore::Entry* PositionStore::_find(std::uint64_t xMask,
+                                                 std::uint64_t oMask) const {
+    const std::uint64_t MASK = _header->capacity - 1;
+    const std::uint64_t KEY = xMask | _OCCUPIED;
+    std::uint64_t slot = _hash(xMask, oMask) & MASK;
+
+    for (int probe = 0; probe < PROBE_LIMIT; ++probe) {
+        const Entry& entry = _entries[slot];
+        if (entry.xKey == 0) {
+            return nullptr;
+        }
+        if (entry.xKey == KEY && entry.oMask == oMask) {
+            return &entry;
+        }
+        slot = (slot + 1) & MASK;
+    }
+    return nullptr;
+}
+
+PositionStore::Entry* PositionStore::_findOrInsert(std::uint64_t xMask,
+                                                   std::uint64_t oMask) {
+    const std::uint64_t MASK = _header->capacity - 1;
+    const std::uint64_t KEY = xMask | _OCCUPIED;
+    std::uint64_t slot = _hash(xMask, oMask) & MASK;
+    Entry* leastVisited = nullptr;
+
+    for (int probe = 0; probe < PROBE_LIMIT; ++probe) {
+        Entry& entry = _entries[slot];
+        if (entry.xKey == 0) {
+            entry.xKey = KEY;
+            entry.oMask = oMask;
+            entry.statistics = PositionStatistics();
+            ++_header->size;
+            return &entry;
+        }
+        if (entry.xKey == KEY && entry.oMask == oMask) {
+            return &entry;
+        }
+        if (leastVisited == nullptr ||
+            entry.statistics.visits < leastVisited->statistics.visits) {
+            leastVisited = &entry;
+        }
+        slot = (slot + 1) & MASK;
+    }
+
+    leastVisited->xKey = KEY;
+    leastVisited->oMask = oMask;
+    leastVisited->statistics = PositionStatistics();
+    return leastVisited;
+}
+
+/**
+ * Get the stored statistics of each state, zero for unknown states.
+ */
+std::vector<PositionStatistics> PositionStore::lookup(
+    const std::vector<ConnectFourState>& states) const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    flock(_fd, LOCK_SH);
+
+    std::vector<PositionStatistics> statistics;
+    for (const ConnectFourState& state : states) {
+        const Entry* ENTRY =
+            _find(state.playerMask(ConnectFourState::Player::X),
+                  state.playerMask(ConnectFourState::Player::O));
+        statistics.push_back(ENTRY ? ENTRY->statistics : PositionStatistics());
+    }
+
+    flock(_fd, LOCK_UN);
+    return statistics;
+}
+
+/**
+ * Add new statistics to the stored statistics of each state.
+ */
+void PositionStore::add(const std::vector<ConnectFourState>& states,
+                        const std::vector<PositionStatistics>& statistics) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    flock(_fd, LOCK_EX);
+
+    for (int i = 0; i < states.size(); ++i) {
+        if (statistics[i].visits == 0) {
+            continue;
+        }
+        Entry* entry =
+            _findOrInsert(states[i].playerMask(ConnectFourState::Player::X),
+                          states[i].playerMask(ConnectFourState::Player::O));
+        entry->statistics.visits += statistics[i].visits;
+        entry->statistics.wins += statistics[i].wins;
+        entry->statistics.losses += statistics[i].losses;
+        entry->statistics.draws += statistics[i].draws;
+    }
+
+    flock(_fd, LOCK_UN);
+}
+
+/**
+ * The store pMCTS seeds column scores from and writes results back to, or
+ * nullptr when none is open.
+ */
+std::unique_ptr<PositionStore>& pMCTS_PositionStore() {
+    static std::unique_ptr<PositionStore> store;
+    return store;
+}
+
+/**
+ * The most playthroughs a position's stored results count as when they seed
+ * a decision. Stored counts grow with every session, and unscaled they would
+ * drown out the decision's own playthroughs and stop UCB1 and sequential
+ * halving from exploring.
+ */
+long& pMCTS_PositionStorePlaythroughs() {
+    static long playthroughs = 30;
+    return playthroughs;
+}
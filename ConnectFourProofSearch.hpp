@@ -0,0 +1,475 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourState.hpp"
+
+/**
+ * Depth-first proof-number search (df-pn) for forced wins and losses.
+ *
+ * The search first tries to prove that the player to move can force a win.
+ * If that fails within half of the node budget (and of the time, when a
+ * deadline is given) it tries, with what is left, to prove that the other
+ * player can force a win, which also finds the individual columns that lose
+ * by force.
+ *
+ * Positions are small bitboards in the layout of
+ * ConnectFourState::playerMask(). Moves that lose at once (leaving an
+ * immediate win unblocked, or playing under one of the opponent's winning
+ * cells) are never expanded, and positions where the player to move can win
+ * at once are leaves.
+ *
+ * Proof and disproof numbers are kept in a fixed size, always-replace
+ * transposition table, so memory stays bounded however long the search runs.
+ *
+ * Citations
+ *
+ *  Ayumu Nagai, "Df-pn Algorithm for Searching AND/OR Trees and Its
+ *  Applications", PhD thesis, University of Tokyo, 2002.
+ *
+ *  Pascal Pons, "Solving Connect 4: how to build a perfect AI".
+ *      Bitboard moves, winning cells and non-losing moves.
+ */
+
+enum class ProofOutcome { UNKNOWN, WIN, LOSS };
+
+std::string proofOutcomeToString(ProofOutcome outcome) {
+    switch (outcome) {
+        case ProofOutcome::UNKNOWN:
+            return "UNKNOWN";
+        case ProofOutcome::WIN:
+            return "WIN";
+        case ProofOutcome::LOSS:
+            return "LOSS";
+        default:
+            throw std::logic_error("An unknown proof outcome was passed.");
+    }
+}
+
+struct ProofResult {
+    // For the player to move.
+    ProofOutcome outcome = ProofOutcome::UNKNOWN;
+    // A winning column when the outcome is a win.
+    int column = -1;
+    // Columns proven to lose, even when the position as a whole is not.
+    std::vector<int> losingColumns;
+    long nodes = 0;
+};
+
+class ProofSearch {
+   public:
+    ProofSearch(std::uint64_t tableEntries = 1 << 18);
+
+    ProofResult prove(const ConnectFourState& state, long maxNodes,
+                      std::chrono::steady_clock::time_point deadline =
+                          std::chrono::steady_clock::time_point::max());
+
+   private:
+    static const std::uint32_t _INFINITY = 1u << 30;
+    static const int _COLUMNS = 7;
+    static const int _HEIGHT = 7;
+
+    struct Position {
+        // Pieces of the player to move, and all pieces.
+        std::uint64_t current;
+        std::uint64_t mask;
+        int moves;
+    };
+
+    struct Numbers {
+        std::uint32_t proof;
+        std::uint32_t disproof;
+    };
+
+    struct Entry {
+        std::uint64_t key;
+        Numbers numbers;
+    };
+
+    std::vector<Entry> _table;
+    int _attackerParity;
+    long _nodes;
+    long _maxNodes;
+    std::chrono::steady_clock::time_point _deadline;
+    // Budget checks left before the clock is read again.
+    int _clockCountdown;
+    bool _expired;
+
+    static std::uint64_t _bottomMask();
+    static std::uint64_t _boardMask();
+    static bool _hasFour(std::uint64_t pieces);
+    static std::uint64_t _winningCells(std::uint64_t pieces,
+                                       std::uint64_t mask);
+    static Position _play(const Position& position, std::uint64_t move);
+
+    bool _attackerToMove(const Position& position) const;
+    bool _decided(const Position& position, bool& attackerWins) const;
+    bool _exhausted();
+    Numbers _initial(const Position& position) const;
+    std::uint64_t _key(const Position& position) const;
+    bool _lookup(const Position& position, Numbers& numbers) const;
+    void _store(const Position& position, const Numbers& numbers);
+    Numbers _search(const Position& position, std::uint32_t proofThreshold,
+                    std::uint32_t disproofThreshold,
+                    std::vector<std::pair<int, Numbers>>* rootChildren);
+};
+
+ProofSearch::ProofSearch(std::uint64_t tableEntries)
+    : _attackerParity(0),
+      _nodes(0),
+      _maxNodes(0),
+      _clockCountdown(0),
+      _expired(false) {
+    std::uint64_t roundedEntries = 1;
+    while (roundedEntries < tableEntries) {
+        roundedEntries <<= 1;
+    }
+    _table.assign(roundedEntries, Entry{0, {1, 1}});
+}
+
+std::uint64_t ProofSearch::_bottomMask() {
+    std::uint64_t bottom = 0;
+    for (int column = 0; column < _COLUMNS; ++column) {
+        bottom |= std::uint64_t(1) << (column * _HEIGHT);
+    }
+    return bottom;
+}
+
+std::uint64_t ProofSearch::_boardMask() {
+    return _bottomMask() * ((std::uint64_t(1) << (_HEIGHT - 1)) - 1);
+}
+
+bool ProofSearch::_hasFour(std::uint64_t pieces) {
+    const int SHIFTS[4] = {1, _HEIGHT, _HEIGHT - 1, _HEIGHT + 1};
+    for (int shift : SHIFTS) {
+        const std::uint64_t PAIRS = pieces & (pieces >> shift);
+        if (PAIRS & (PAIRS >> 2 * shift)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Empty cells that would complete four in a row for PIECES.
+ */
+std::uint64_t ProofSearch::_winningCells(std::uint64_t pieces,
+                                         std::uint64_t mask) {
+    std::uint64_t wins = (pieces << 1) & (pieces << 2) & (pieces << 3);
+
+    for (int shift : {_HEIGHT, _HEIGHT - 1, _HEIGHT + 1}) {
+        std::uint64_t pair = (pieces << shift) & (pieces << 2 * shift);
+        wins |= pair & (pieces << 3 * shift);
+        wins |= pair & (pieces >> shift);
+        pair = (pieces >> shift) & (pieces >> 2 * shift);
+        wins |= pair & (pieces << shift);
+        wins |= pair & (pieces >> 3 * shift);
+    }
+
+    return wins & _boardMask() & ~mask;
+}
+
+/**
+ * Play the cell MOVE, which must be playable.
+ */
+ProofSearch::Position ProofSearch::_play(const Position& position,
+                                         std::uint64_t move) {
+    Position next;
+    next.current = position.current ^ position.mask;
+    next.mask = position.mask | move;
+    next.moves = position.moves + 1;
+    return next;
+}
+
+bool ProofSearch::_attackerToMove(const Position& position) const {
+    return position.moves % 2 == _attackerParity;
+}
+
+/**
+ * Find if the result of the position is already known. Draws count as
+ * failures of the attacker.
+ */
+bool ProofSearch::_decided(const Position& position,
+                           bool& attackerWins) const {
+    const std::uint64_t OTHER = position.current ^ position.mask;
+    if (_hasFour(OTHER)) {
+        attackerWins = !_attackerToMove(position);
+        return true;
+    }
+
+    const std::uint64_t PLAYABLE =
+        (position.mask + _bottomMask()) & _boardMask();
+    if (PLAYABLE == 0) {
+        attackerWins = false;
+        return true;
+    }
+
+    if (_winningCells(position.current, position.mask) & PLAYABLE) {
+        attackerWins = _attackerToMove(position);
+        return true;
+    }
+
+    // Two threats cannot both be blocked, and blocking a threat with another
+    // winning cell above it opens that cell.
+    const std::uint64_t OTHER_WINS = _winningCells(OTHER, position.mask);
+    const std::uint64_t THREATS = OTHER_WINS & PLAYABLE;
+    if ((THREATS & (THREATS - 1)) || (THREATS & (OTHER_WINS >> 1))) {
+        attackerWins = !_attackerToMove(position);
+        return true;
+    }
+
+    return false;
+}
+
+ProofSearch::Numbers ProofSearch::_initial(const Position& position) const {
+    Numbers numbers;
+    if (_lookup(position, numbers)) {
+        return numbers;
+    }
+
+    bool attackerWins;
+    if (_decided(position, attackerWins)) {
+        return attackerWins ? Numbers{0, _INFINITY} : Numbers{_INFINITY, 0};
+    }
+    return Numbers{1, 1};
+}
+
+std::uint64_t ProofSearch::_key(const Position& position) const {
+    // The attacker is part of the key, so both searches share one table.
+    return (position.current + position.mask + _bottomMask()) |
+           (std::uint64_t(_attackerParity) << 63);
+}
+
+bool ProofSearch::_lookup(const Position& position, Numbers& numbers) const {
+    const std::uint64_t KEY = _key(position);
+    const Entry& ENTRY =
+        _table[(KEY * 0x9e3779b97f4a7c15ULL) >> 32 & (_table.size() - 1)];
+    if (ENTRY.key == KEY) {
+        numbers = ENTRY.numbers;
+        return true;
+    }
+    return false;
+}
+
+void ProofSearch::_store(const Position& position, const Numbers& numbers) {
+    const std::uint64_t KEY = _key(position);
+    Entry& entry =
+        _table[(KEY * 0x9e3779b97f4a7c15ULL) >> 32 & (_table.size() - 1)];
+    entry.key = KEY;
+    entry.numbers = numbers;
+}
+
+/**
+ * Expand POSITION until its proof number reaches PROOF_THRESHOLD, its
+ * disproof number reaches DISPROOF_THRESHOLD or the node budget runs out.
+ * The root expands every legal column and reports their numbers in
+ * ROOT_CHILDREN.
+ */
+ProofSearch::Numbers ProofSearch::_search(
+    const Position& position, std::uint32_t proofThreshold,
+    std::uint32_t disproofThreshold,
+    std::vector<std::pair<int, Numbers>>* rootChildren) {
+    ++_nodes;
+
+    bool attackerWins;
+    if (rootChildren == nullptr && _decided(position, attackerWins)) {
+        const Numbers NUMBERS =
+            attackerWins ? Numbers{0, _INFINITY} : Numbers{_INFINITY, 0};
+        _store(position, NUMBERS);
+        return NUMBERS;
+    }
+
+    const std::uint64_t PLAYABLE =
+        (position.mask + _bottomMask()) & _boardMask();
+    std::uint64_t moves = PLAYABLE;
+    if (rootChildren == nullptr) {
+        // Not decided, so there is at most one threat to block and it has no
+        // winning cell above it.
+        const std::uint64_t OTHER_WINS =
+            _winningCells(position.current ^ position.mask, position.mask);
+        const std::uint64_t FORCED = PLAYABLE & OTHER_WINS;
+        moves = (FORCED ? FORCED : PLAYABLE) & ~(OTHER_WINS >> 1);
+        if (moves == 0) {
+            // Every move gives the other player a win.
+            const Numbers NUMBERS = _attackerToMove(position)
+                                        ? Numbers{_INFINITY, 0}
+                                        : Numbers{0, _INFINITY};
+            _store(position, NUMBERS);
+            return NUMBERS;
+        }
+    }
+
+    // Centre columns first, they are the likeliest to matter.
+    const int ORDER[_COLUMNS] = {3, 2, 4, 1, 5, 0, 6};
+    std::array<int, _COLUMNS> columns;
+    std::array<Position, _COLUMNS> children;
+    std::array<Numbers, _COLUMNS> numbers;
+    int count = 0;
+    for (int column : ORDER) {
+        const std::uint64_t MOVE =
+            moves & (((std::uint64_t(1) << (_HEIGHT - 1)) - 1)
+                     << (column * _HEIGHT));
+        if (MOVE) {
+            columns[count] = column;
+            children[count] = _play(position, MOVE);
+            numbers[count] = _initial(children[count]);
+            ++count;
+        }
+    }
+
+    const bool OR_NODE = _attackerToMove(position);
+    Numbers current;
+
+    while (true) {
+        // Proof and disproof numbers from the children, and the child to
+        // expand with the runner up's number.
+        std::uint64_t sum = 0;
+        std::uint32_t best = _INFINITY + 1;
+        std::uint32_t second = _INFINITY;
+        int bestIndex = 0;
+        for (int i = 0; i < count; ++i) {
+            const std::uint32_t MINIMISED =
+                OR_NODE ? numbers[i].proof : numbers[i].disproof;
+            sum += OR_NODE ? numbers[i].disproof : numbers[i].proof;
+            if (MINIMISED < best) {
+                second = best;
+                best = MINIMISED;
+                bestIndex = i;
+            } else if (MINIMISED < second) {
+                second = MINIMISED;
+            }
+        }
+        const std::uint32_t SUM =
+            static_cast<std::uint32_t>(std::min<std::uint64_t>(sum, _INFINITY));
+        current = OR_NODE ? Numbers{best, SUM} : Numbers{SUM, best};
+
+        if (current.proof >= proofThreshold ||
+            current.disproof >= disproofThreshold || _exhausted()) {
+            break;
+        }
+
+        const Numbers& CHILD = numbers[bestIndex];
+        std::uint32_t childProof;
+        std::uint32_t childDisproof;
+        if (OR_NODE) {
+            childProof = std::min(proofThreshold, second + 1);
+            childDisproof = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+                std::uint64_t(disproofThreshold) - current.disproof +
+                    CHILD.disproof,
+                _INFINITY));
+        } else {
+            childProof = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+                std::uint64_t(proofThreshold) - current.proof + CHILD.proof,
+                _INFINITY));
+            childDisproof = std::min(disproofThreshold, second + 1);
+        }
+
+        numbers[bestIndex] =
+            _search(children[bestIndex], childProof, childDisproof, nullptr);
+    }
+
+    _store(position, current);
+    if (rootChildren != nullptr) {
+        rootChildren->clear();
+        for (int i = 0; i < count; ++i) {
+            rootChildren->push_back({columns[i], numbers[i]});
+        }
+    }
+    return current;
+}
+
+/**
+ * Find if the node budget or the time has run out. The clock is read every
+ * 64 checks, a few tens of microseconds of searching.
+ */
+bool ProofSearch::_exhausted() {
+    if (_nodes >= _maxNodes) {
+        return true;
+    }
+    if (!_expired && --_clockCountdown <= 0) {
+        _clockCountdown = 64;
+        _expired = std::chrono::steady_clock::now() >= _deadline;
+    }
+    return _expired;
+}
+
+/**
+ * Search STATE within a budget of MAX_NODES expanded nodes, stopping at
+ * DEADLINE. The win search gets half of the nodes and of the time.
+ */
+ProofResult ProofSearch::prove(const ConnectFourState& state, long maxNodes,
+                               std::chrono::steady_clock::time_point deadline) {
+    ProofResult result;
+    if (state.isOver()) {
+        return result;
+    }
+
+    Position root;
+    root.current = state.playerMask(state.currentPlayer());
+    root.mask = state.playerMask(ConnectFourState::Player::X) |
+                state.playerMask(ConnectFourState::Player::O);
+    root.moves = __builtin_popcountll(root.mask);
+
+    std::vector<std::pair<int, Numbers>> children;
+    _nodes = 0;
+
+    const std::chrono::steady_clock::time_point NOW =
+        std::chrono::steady_clock::now();
+    _clockCountdown = 0;
+    _expired = false;
+
+    // Can the player to move force a win?
+    _attackerParity = root.moves % 2;
+    _maxNodes = maxNodes / 2;
+    _deadline = (deadline == std::chrono::steady_clock::time_point::max())
+                    ? deadline
+                    : NOW + (deadline - NOW) / 2;
+    if (_search(root, _INFINITY, _INFINITY, &children).proof == 0) {
+        for (const auto& CHILD : children) {
+            if (CHILD.second.proof == 0) {
+                result.column = CHILD.first;
+                break;
+            }
+        }
+        result.outcome = ProofOutcome::WIN;
+        result.nodes = _nodes;
+        return result;
+    }
+
+    // Can the other player?
+    _attackerParity = 1 - root.moves % 2;
+    _maxNodes = maxNodes;
+    _deadline = deadline;
+    _clockCountdown = 0;
+    _expired = false;
+    const bool LOST = _search(root, _INFINITY, _INFINITY, &children).proof == 0;
+    for (const auto& CHILD : children) {
+        if (CHILD.second.proof == 0) {
+            result.losingColumns.push_back(CHILD.first);
+        }
+    }
+    std::sort(result.losingColumns.begin(), result.losingColumns.end());
+    if (LOST) {
+        result.outcome = ProofOutcome::LOSS;
+    }
+    result.nodes = _nodes;
+    return result;
+}
+
+/**
+ * The proof search decisions use on this thread, and its node budget (0 turns
+ * it off).
+ */
+ProofSearch& pMCTS_ProofSearch() {
+    thread_local ProofSearch search;
+    return search;
+}
+
+long& pMCTS_ProofNodes() {
+    static long nodes = 0;
+    return nodes;
+}
@@ -0,0 +1,380 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ConnectFourPMCTS.hpp"
+#include "ConnectFourState.hpp"
+
+/**
+ * Self-play training data: every ply of games the engine plays against
+ * itself, in fixed-size binary records that can be appended to, streamed and
+ * memory-mapped.
+ *
+ * File format (little endian):
+ *      char[4]  "C4SP"
+ *      uint32   version (1)
+ *      uint32   record size (80)
+ *      uint32   reserved
+ *      SelfPlayRecord[]
+ *
+ * Board masks use the bitboard layout of ConnectFourState::playerMask(): bit
+ * column * 7 + (5 - row), row 0 at the top. Visits and scores are indexed by
+ * column. Scores are wins minus losses of the playthroughs, and the result is
+ * the final result of the game, both from the point of view of the player to
+ * move. Visits and scores are zero for columns that were not searched:
+ *  - Full columns.
+ *  - Columns proof search proved to lose, which have their bit set in the
+ *    flags by selfPlay_ProvenLossFlag().
+ *  - Every column of a record with the SELF_PLAY_PROVEN_WIN flag, whose
+ *    column was played from a proven win without playthroughs.
+ *
+ * Games are appended whole under an exclusive flock(), so several processes
+ * can generate into one file. A reader ignores a trailing partial record.
+ *
+ * Citations
+ *
+ *  https://man7.org/linux/man-pages/man2/mmap.2.html
+ *  https://man7.org/linux/man-pages/man2/madvise.2.html
+ */
+
+struct SelfPlayRecord {
+    std::uint64_t xMask;
+    std::uint64_t oMask;
+    std::uint32_t visits[7];
+    std::int32_t scores[7];
+    std::uint8_t ply;
+    // 0 for X, 1 for O.
+    std::uint8_t toMove;
+    // The column that was played.
+    std::uint8_t column;
+    // 1 for a win, 0 for a draw, -1 for a loss.
+    std::int8_t result;
+    // SELF_PLAY_ flags.
+    std::uint32_t flags;
+
+    ConnectFourState::Player player() const;
+    ConnectFourState state() const;
+};
+
+static_assert(sizeof(SelfPlayRecord) == 80,
+              "Self-play records must stay 80 bytes.");
+
+const std::uint32_t SELF_PLAY_VERSION = 1;
+
+// The column was played from a proven win, without playthroughs.
+const std::uint32_t SELF_PLAY_PROVEN_WIN = 1;
+
+/**
+ * Get the flag of a column proof search proved to lose and left out of the
+ * search, one bit per column from bit 8.
+ */
+std::uint32_t selfPlay_ProvenLossFlag(int column) {
+    return std::uint32_t(1) << (8 + column);
+}
+
+struct SelfPlayHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(SelfPlayHeader) == 16,
+              "The self-play header must stay 16 bytes.");
+
+ConnectFourState::Player SelfPlayRecord::player() const {
+    return (toMove == 0) ? ConnectFourState::Player::X
+                         : ConnectFourState::Player::O;
+}
+
+/**
+ * Rebuild the position. The last placed piece is not recorded.
+ */
+ConnectFourState SelfPlayRecord::state() const {
+    std::string encoded;
+    for (int row = 0; row < 6; ++row) {
+        for (int column = 0; column < 7; ++column) {
+            const std::uint64_t BIT = std::uint64_t(1)
+                                      << (column * 7 + 5 - row);
+            encoded += (xMask & BIT) ? 'X' : ((oMask & BIT) ? 'O' : '-');
+        }
+    }
+    encoded += (toMove == 0) ? 'X' : 'O';
+    encoded += '-';
+    return ConnectFourState::decode(encoded);
+}
+
+/**
+ * Appends games to a self-play file, creating it if needed. Safe to share
+ * between threads.
+ */
+class SelfPlayWriter {
+   public:
+    SelfPlayWriter(const std::string& filename);
+    ~SelfPlayWriter();
+
+    SelfPlayWriter(const SelfPlayWriter&) = delete;
+    SelfPlayWriter& operator=(const SelfPlayWriter&) = delete;
+
+    void writeGame(const std::vector<SelfPlayRecord>& records);
+
+   private:
+    const std::string _FILENAME;
+    int _fd;
+    std::mutex _mutex;
+};
+
+SelfPlayWriter::SelfPlayWriter(const std::string& filename)
+    : _FILENAME(filename), _fd(-1) {
+    _fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    flock(_fd, LOCK_EX);
+    struct stat status;
+    fstat(_fd, &status);
+
+    SelfPlayHeader header;
+    std::memset(&header, 0, sizeof(header));
+    bool valid = true;
+    if (status.st_size == 0) {
+        std::memcpy(header.magic, "C4SP", 4);
+        header.version = SELF_PLAY_VERSION;
+        header.recordSize = sizeof(SelfPlayRecord);
+        valid = write(_fd, &header, sizeof(header)) ==
+                static_cast<ssize_t>(sizeof(header));
+    } else {
+        valid = pread(_fd, &header, sizeof(header), 0) ==
+                    static_cast<ssize_t>(sizeof(header)) &&
+                std::memcmp(header.magic, "C4SP", 4) == 0 &&
+                header.version == SELF_PLAY_VERSION &&
+                header.recordSize == sizeof(SelfPlayRecord);
+    }
+    flock(_fd, LOCK_UN);
+
+    if (!valid) {
+        close(_fd);
+        throw std::runtime_error("\'" + filename +
+                                 "\' is not a self-play data file.");
+    }
+}
+
+SelfPlayWriter::~SelfPlayWriter() { close(_fd); }
+
+void SelfPlayWriter::writeGame(const std::vector<SelfPlayRecord>& records) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    flock(_fd, LOCK_EX);
+
+    const char* data = reinterpret_cast<const char*>(records.data());
+    size_t remaining = records.size() * sizeof(SelfPlayRecord);
+    while (remaining > 0) {
+        const ssize_t WRITTEN = write(_fd, data, remaining);
+        if (WRITTEN < 0 && errno == EINTR) {
+            continue;
+        }
+        if (WRITTEN <= 0) {
+            flock(_fd, LOCK_UN);
+            throw std::runtime_error("\'" + _FILENAME +
+                                     "\' could not be written.");
+        }
+        data += WRITTEN;
+        remaining -= WRITTEN;
+    }
+
+    flock(_fd, LOCK_UN);
+}
+
+// How a reader will go through the records, passed on to the kernel's page
+// cache as madvise() advice.
+enum class RecordAccess { SEQUENTIAL, RANDOM };
+
+/**
+ * Read-only view of the records in a self-play file, as they were when it was
+ * opened.
+ */
+class SelfPlayReader {
+   public:
+    SelfPlayReader(const std::string& filename,
+                   RecordAccess access = RecordAccess::SEQUENTIAL);
+    ~SelfPlayReader();
+
+    SelfPlayReader(const SelfPlayReader&) = delete;
+    SelfPlayReader& operator=(const SelfPlayReader&) = delete;
+
+    std::uint64_t size() const;
+    const SelfPlayRecord& operator[](std::uint64_t index) const;
+    const SelfPlayRecord* begin() const;
+    const SelfPlayRecord* end() const;
+
+   private:
+    size_t _mappedBytes;
+    void* _mapping;
+    const SelfPlayRecord* _records;
+    std::uint64_t _size;
+};
+
+SelfPlayReader::SelfPlayReader(const std::string& filename,
+                               RecordAccess access)
+    : _mappedBytes(0), _mapping(nullptr), _records(nullptr), _size(0) {
+    const int FD = open(filename.c_str(), O_RDONLY);
+    if (FD < 0) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    struct stat status;
+    fstat(FD, &status);
+    if (status.st_size < static_cast<off_t>(sizeof(SelfPlayHeader))) {
+        close(FD);
+        throw std::runtime_error("\'" + filename +
+                                 "\' is not a self-play data file.");
+    }
+
+    _mappedBytes = status.st_size;
+    _mapping = mmap(nullptr, _mappedBytes, PROT_READ, MAP_SHARED, FD, 0);
+    close(FD);
+    if (_mapping == MAP_FAILED) {
+        throw std::runtime_error("\'" + filename + "\' could not be mapped.");
+    }
+
+    const SelfPlayHeader* HEADER = static_cast<SelfPlayHeader*>(_mapping);
+    if (std::memcmp(HEADER->magic, "C4SP", 4) != 0 ||
+        HEADER->version != SELF_PLAY_VERSION ||
+        HEADER->recordSize != sizeof(SelfPlayRecord)) {
+        munmap(_mapping, _mappedBytes);
+        throw std::runtime_error("\'" + filename +
+                                 "\' is not a self-play data file.");
+    }
+
+    _records = reinterpret_cast<const SelfPlayRecord*>(HEADER + 1);
+    _size = (_mappedBytes - sizeof(SelfPlayHeader)) / sizeof(SelfPlayRecord);
+    madvise(_mapping, _mappedBytes,
+            (access == RecordAccess::RANDOM) ? MADV_RANDOM : MADV_SEQUENTIAL);
+}
+
+SelfPlayReader::~SelfPlayReader() { munmap(_mapping, _mappedBytes); }
+
+std::uint64_t SelfPlayReader::size() const { return _size; }
+
+const SelfPlayRecord& SelfPlayReader::operator[](std::uint64_t index) const {
+    if (index >= _size) {
+        throw std::out_of_range("Record " + std::to_string(index) +
+                                " is past the end of the file.");
+    }
+    return _records[index];
+}
+
+const SelfPlayRecord* SelfPlayReader::begin() const { return _records; }
+
+const SelfPlayRecord* SelfPlayReader::end() const { return _records + _size; }
+
+/**
+ * Play one game of the engine against itself, recording every ply.
+ */
+std::vector<SelfPlayRecord> selfPlay_Game(const PlaythroughMode MODE,
+                                          const long ITERATIONS,
+                                          const RootAllocation ALLOCATION) {
+    ConnectFourState game;
+    std::vector<SelfPlayRecord> records;
+
+    while (!game.isOver()) {
+        const Decision DECISION =
+            pMCTS_DecideColumn(game, MODE, 1.0, DecisionCutoff::ITERATIONS,
+                               ITERATIONS, false, ALLOCATION);
+
+        SelfPlayRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.xMask = game.playerMask(ConnectFourState::Player::X);
+        record.oMask = game.playerMask(ConnectFourState::Player::O);
+        for (const auto& COLUMN : DECISION.columns) {
+            record.visits[COLUMN.first] = COLUMN.second.playthroughs();
+            record.scores[COLUMN.first] = COLUMN.second.score();
+        }
+        record.ply = records.size();
+        record.toMove =
+            (game.currentPlayer() == ConnectFourState::Player::X) ? 0 : 1;
+        record.column = DECISION.column;
+        if (DECISION.proof == ProofOutcome::WIN) {
+            record.flags |= SELF_PLAY_PROVEN_WIN;
+        } else {
+            // Legal columns missing from the search were proven to lose.
+            for (int column : game.legalMoves()) {
+                const auto SEARCHED = std::find_if(
+                    DECISION.columns.begin(), DECISION.columns.end(),
+                    [&](const std::pair<int, PlaythroughTally>& COLUMN) {
+                        return COLUMN.first == column;
+                    });
+                if (SEARCHED == DECISION.columns.end()) {
+                    record.flags |= selfPlay_ProvenLossFlag(column);
+                }
+            }
+        }
+        records.push_back(record);
+
+        game.playColumn(DECISION.column);
+    }
+
+    const ConnectFourState::Player WINNER = game.firstWinner();
+    for (SelfPlayRecord& record : records) {
+        record.result = (WINNER == ConnectFourState::Player::None)
+                            ? 0
+                            : ((WINNER == record.player()) ? 1 : -1);
+    }
+    return records;
+}
+
+/**
+ * Play GAMES self-play games spread over THREADS threads, appending them to
+ * FILENAME. Returns the number of positions written.
+ */
+std::uint64_t selfPlay(const std::string& filename, int games,
+                       int threads = std::thread::hardware_concurrency(),
+                       const PlaythroughMode MODE = PlaythroughMode::HEURISTIC,
+                       const long ITERATIONS = 2000,
+                       const RootAllocation ALLOCATION =
+                           RootAllocation::ROUND_ROBIN) {
+    threads = std::max(threads, 1);
+
+    SelfPlayWriter writer(filename);
+    std::atomic<int> nextGame(0);
+    std::atomic<std::uint64_t> positions(0);
+    std::mutex printMutex;
+    int finished = 0;
+
+    const auto work = [&]() {
+        for (int i = nextGame++; i < games; i = nextGame++) {
+            const std::vector<SelfPlayRecord> RECORDS =
+                selfPlay_Game(MODE, ITERATIONS, ALLOCATION);
+            writer.writeGame(RECORDS);
+            positions += RECORDS.size();
+
+            std::lock_guard<std::mutex> guard(printMutex);
+            std::cout << "Self-play game " << ++finished << "/" << games
+                      << '\n';
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return positions;
+}
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <array>
 #include <climits>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <functional>
@@ -31,6 +32,13 @@ class ConnectFourState {
     bool isOver() const;
     int lastPlacedColumn() const;
     int lastPlacedRow() const;
+    int playableRow(int column) const;
+    Player pieceAt(int column, int row) const;
+    std::uint64_t playerMask(Player player) const;
+    std::uint64_t positionKey() const;
+    std::uint64_t playableCells() const;
+    std::uint64_t winningCells(Player player) const;
+    bool canStillConnect(Player player) const;
     Player firstWinner() const;
     Player currentPlayer() const;
     int evaluate(Player maxPlayer) const;
@@ -43,6 +51,8 @@ class ConnectFourState {
     ConnectFourState applyMove(int column) const;
 
     std::string toString() const;
+    std::string encode() const;
+    static ConnectFourState decode(const std::string& encoded);
     static std::string playerToString(Player player);
     friend std::ostream& operator<<(std::ostream& os,
                                     const ConnectFourState& state);
@@ -62,6 +72,8 @@ class ConnectFourState {
     Player _current_player;
     Player _first_winner;
     std::array<std::array<char, 7>, 6> _state;
+    std::uint64_t _x_mask;
+    std::uint64_t _o_mask;
     int _lastPlacedColumn;
     int _lastPlacedRow;
 
@@ -73,12 +85,17 @@ class ConnectFourState {
     bool _checkWinGeneral(const std::array<std::array<char, 7>, 6>& stateVector,
                           int column, int row) const;
     bool _checkWin(int column, int row) const;
+    std::uint64_t _bottomMask() const;
+    std::uint64_t _boardMask() const;
+    static bool _hasFour(std::uint64_t mask);
     void _deepcopy(const ConnectFourState& state);
 };
 
 ConnectFourState::ConnectFourState()
     : _current_player(Player::X),
       _first_winner(Player::None),
+      _x_mask(0),
+      _o_mask(0),
       _lastPlacedColumn(-1),
       _lastPlacedRow(-1) {
     _defaultFill();
@@ -109,6 +126,95 @@ bool ConnectFourState::isOver() const { return isWon() || isDraw(); }
 int ConnectFourState::lastPlacedColumn() const { return _lastPlacedColumn; }
 int ConnectFourState::lastPlacedRow() const { return _lastPlacedRow; }
 
+/**
+ * Get the row a piece played in the column would land in, or -1 if the column
+ * is full.
+ */
+int ConnectFourState::playableRow(int column) const {
+    return _lowest_playable_row(column);
+}
+
+/**
+ * Get the owner of a cell, or None for empty cells and cells off the board.
+ */
+ConnectFourState::Player ConnectFourState::pieceAt(int column, int row) const {
+    if (column < 0 || column >= _COLUMNS || row < 0 || row >= _ROWS) {
+        return Player::None;
+    }
+    const char PIECE = _state[row][column];
+    return (PIECE == _PLAYER_X_STATE)
+               ? Player::X
+               : ((PIECE == _PLAYER_O_STATE) ? Player::O : Player::None);
+}
+
+/**
+ * Get the cells owned by a player as a bitboard. Column c occupies bits 7c to
+ * 7c + 5 from the bottom row up, bit 7c + 6 is always clear.
+ */
+std::uint64_t ConnectFourState::playerMask(Player player) const {
+    switch (player) {
+        case Player::X:
+            return _x_mask;
+        case Player::O:
+            return _o_mask;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Get the cells, as a bitboard, that the next piece in each column would land
+ * in.
+ */
+std::uint64_t ConnectFourState::playableCells() const {
+    return ((_x_mask | _o_mask) + _bottomMask()) & _boardMask();
+}
+
+/**
+ * Get the empty cells, as a bitboard, that would complete four in a row for
+ * the player. They need not be playable yet.
+ */
+std::uint64_t ConnectFourState::winningCells(Player player) const {
+    // Citation
+    //    Pascal Pons, "Solving Connect 4: how to build a perfect AI",
+    //    compute_winning_position.
+    const std::uint64_t OWN = playerMask(player);
+    const int VERTICAL = 1;
+    const int SHIFTS[3] = {_ROWS + 1, _ROWS, _ROWS + 2};
+
+    std::uint64_t wins = (OWN << VERTICAL) & (OWN << 2 * VERTICAL) &
+                         (OWN << 3 * VERTICAL);
+
+    for (int shift : SHIFTS) {
+        std::uint64_t pair = (OWN << shift) & (OWN << 2 * shift);
+        wins |= pair & (OWN << 3 * shift);
+        wins |= pair & (OWN >> shift);
+        pair = (OWN >> shift) & (OWN >> 2 * shift);
+        wins |= pair & (OWN << shift);
+        wins |= pair & (OWN >> 3 * shift);
+    }
+
+    return wins & _boardMask() & ~(_x_mask | _o_mask);
+}
+
+/**
+ * Find if the player could still complete four in a row if they got every
+ * empty cell.
+ */
+bool ConnectFourState::canStillConnect(Player player) const {
+    const std::uint64_t EMPTY = _boardMask() & ~(_x_mask | _o_mask);
+    return _hasFour(playerMask(player) | EMPTY);
+}
+
+/**
+ * Get a key that is unique to the pieces on the board. Adding the bottom row
+ * to the occupied cells leaves one marker bit above each column's stack, and
+ * X's pieces fill in the bits below it.
+ */
+std::uint64_t ConnectFourState::positionKey() const {
+    return (_x_mask | _o_mask) + _bottomMask() + _x_mask;
+}
+
 ConnectFourState::Player ConnectFourState::firstWinner() const {
     return _first_winner;
 }
@@ -197,10 +303,11 @@ void ConnectFourState::playColumn(int column) {
  */
 std::vector<int> ConnectFourState::legalMoves() const {
     std::vector<int> moves;
-    for (int column = 0; column < _COLUMNS; ++column) {
-        if (_column_playable(column)) {
-            moves.push_back(column);
-        }
+    moves.reserve(_COLUMNS);
+    // Lowest set bit first, so columns come out in order.
+    for (std::uint64_t playable = playableCells(); playable != 0;
+         playable &= playable - 1) {
+        moves.push_back(__builtin_ctzll(playable) / (_ROWS + 1));
     }
     return moves;
 }
@@ -252,6 +359,83 @@ std::string ConnectFourState::toString() const {
     return representation;
 }
 
+/**
+ * Serialize the board, the player to move and the first winner into a single
+ * whitespace-free token, suitable for sending to another process.
+ */
+std::string ConnectFourState::encode() const {
+    const char EMPTY_CHAR = '-';
+    std::string encoded;
+    for (int row = 0; row < _ROWS; ++row) {
+        for (int column = 0; column < _COLUMNS; ++column) {
+            const char CURRENT_STATE = _state[row][column];
+            encoded += (CURRENT_STATE == _EMPTY_STATE) ? EMPTY_CHAR
+                                                       : CURRENT_STATE;
+        }
+    }
+    encoded += (_current_player == Player::X) ? _PLAYER_X_STATE
+                                               : _PLAYER_O_STATE;
+    encoded += (_first_winner == Player::None)
+                   ? EMPTY_CHAR
+                   : _map_player_to_state(_first_winner);
+    return encoded;
+}
+
+/**
+ * Rebuild a state produced by encode(). The last placed piece is not part of
+ * the encoding.
+ */
+ConnectFourState ConnectFourState::decode(const std::string& encoded) {
+    ConnectFourState decoded;
+    const int CELLS = decoded._ROWS * decoded._COLUMNS;
+
+    if (encoded.size() != static_cast<size_t>(CELLS + 2)) {
+        throw std::invalid_argument("\'" + encoded +
+                                    "\' is not an encoded state.");
+    }
+
+    const auto decodePlayer = [&](char c) -> Player {
+        switch (c) {
+            case 'X':
+                return Player::X;
+            case 'O':
+                return Player::O;
+            case '-':
+                return Player::None;
+            default:
+                throw std::invalid_argument("\'" + encoded +
+                                            "\' is not an encoded state.");
+        }
+    };
+
+    for (int cell = 0; cell < CELLS; ++cell) {
+        const Player PIECE = decodePlayer(encoded[cell]);
+        const int ROW = cell / decoded._COLUMNS;
+        const int COLUMN = cell % decoded._COLUMNS;
+        decoded._state[ROW][COLUMN] = (PIECE == Player::None)
+                                          ? decoded._EMPTY_STATE
+                                          : decoded._map_player_to_state(PIECE);
+        const std::uint64_t BIT = std::uint64_t(1)
+                                  << (COLUMN * (decoded._ROWS + 1) +
+                                      (decoded._ROWS - 1 - ROW));
+        if (PIECE == Player::X) {
+            decoded._x_mask |= BIT;
+        } else if (PIECE == Player::O) {
+            decoded._o_mask |= BIT;
+        }
+    }
+
+    decoded._current_player = decodePlayer(encoded[CELLS]);
+    decoded._first_winner = decodePlayer(encoded[CELLS + 1]);
+
+    if (decoded._current_player == Player::None) {
+        throw std::invalid_argument("\'" + encoded +
+                                    "\' has no player to move.");
+    }
+
+    return decoded;
+}
+
 std::string ConnectFourState::playerToString(Player player) {
     return (player == Player::X) ? "X" : ((player == Player::O) ? "O" : " ");
 }
@@ -304,6 +488,13 @@ void ConnectFourState::_setColumn(int column, Player player) {
     if (_column_playable(column)) {
         int row = _lowest_playable_row(column);
         _state[row][column] = _map_player_to_state(player);
+        const std::uint64_t BIT = std::uint64_t(1)
+                                  << (column * (_ROWS + 1) + (_ROWS - 1 - row));
+        if (player == Player::X) {
+            _x_mask |= BIT;
+        } else {
+            _o_mask |= BIT;
+        }
         _lastPlacedRow = row;
         _lastPlacedColumn = column;
 
@@ -379,11 +570,40 @@ bool ConnectFourState::_checkWinGeneral(
     return false;
 }
 
+std::uint64_t ConnectFourState::_bottomMask() const {
+    std::uint64_t bottom = 0;
+    for (int column = 0; column < _COLUMNS; ++column) {
+        bottom |= std::uint64_t(1) << (column * (_ROWS + 1));
+    }
+    return bottom;
+}
+
+std::uint64_t ConnectFourState::_boardMask() const {
+    return _bottomMask() * ((std::uint64_t(1) << _ROWS) - 1);
+}
+
+bool ConnectFourState::_hasFour(std::uint64_t mask) {
+    const int SHIFTS[4] = {1, 7, 6, 8};
+    for (int shift : SHIFTS) {
+        const std::uint64_t PAIRS = mask & (mask >> shift);
+        if (PAIRS & (PAIRS >> 2 * shift)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
- * Find if there is a win along the coordinate.
+ * Find if the piece at the coordinate completed four in a row. Every four is
+ * completed by some piece, so the bitboard test of its player's pieces only
+ * finds the one it completed.
  */
 bool ConnectFourState::_checkWin(int column, int row) const {
-    return _checkWinGeneral(_state, column, row);
+    const char PIECE = _state[row][column];
+    if (PIECE == _EMPTY_STATE) {
+        return false;
+    }
+    return _hasFour((PIECE == _PLAYER_X_STATE) ? _x_mask : _o_mask);
 }
 
 void ConnectFourState::_deepcopy(const ConnectFourState& state) {
@@ -391,6 +611,8 @@ void ConnectFourState::_deepcopy(const ConnectFourState& state) {
         _current_player = state._current_player;
         _first_winner = state._first_winner;
         _state = state._state;
+        _x_mask = state._x_mask;
+        _o_mask = state._o_mask;
     }
 }
 
@@ -0,0 +1,341 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ConnectFourState.hpp"
+#include "CpuDispatch.hpp"
+
+#if CPU_HAS_X86_64_V3
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Small quantized value network for evaluating positions on the CPU.
+ *
+ * Layout:
+ *      84 inputs (an X plane and an O plane of 42 cells each, cell = row * 7 +
+ *      column with row 0 at the top)
+ *      -> 32 int16 accumulators, clipped to [0, 127]
+ *      -> 32 int8 weighted sums, shifted right by 6 and clipped to [0, 127]
+ *      -> 1 int8 weighted sum, scaled by 1 / (127 * 64) and squashed by tanh
+ *
+ * The output is the value of the position for X, in [-1, 1]. As in NNUE, the
+ * first layer is kept as an accumulator that a placed piece updates with one
+ * row of weights, instead of being recomputed. Only the root is evaluated
+ * this way: evaluateChildren() refreshes the root's accumulator once and
+ * adds one piece per child. Playthroughs never evaluate the network, so no
+ * accumulator follows ConnectFourState::playColumn() along them.
+ *
+ * Weights are trained offline from self-play data (ConnectFour
+ * --train-network).
+ *
+ * The AVX2 kernels are chosen at runtime by cpu_Target(). NEON is part of the
+ * arm64 baseline and is always used there.
+ *
+ * File format (little endian):
+ *      char[4]  "C4VN"
+ *      uint32   version (1)
+ *      uint32   inputs (84), first hidden size (32), second hidden size (32)
+ *      int16    first layer weights [84][32], biases [32]
+ *      int8     second layer weights [32 outputs][32 inputs]
+ *      int32    second layer biases [32]
+ *      int8     output weights [32]
+ *      int32    output bias
+ *
+ * Citations
+ *
+ *  https://github.com/official-stockfish/nnue-pytorch/blob/master/docs/nnue.md
+ *      Accumulators, quantization and the int8 layer kernels.
+ */
+
+class ValueNetwork {
+   public:
+    static const int INPUTS = 84;
+    static const int HIDDEN_1 = 32;
+    static const int HIDDEN_2 = 32;
+    static const uint32_t VERSION = 1;
+
+    struct Accumulator {
+        alignas(32) int16_t values[HIDDEN_1];
+    };
+
+    ValueNetwork();
+
+    static int featureIndex(int column, int row, ConnectFourState::Player player);
+
+    void refresh(Accumulator& accumulator, const ConnectFourState& state) const;
+    void addPiece(Accumulator& accumulator, int column, int row,
+                  ConnectFourState::Player player) const;
+    double evaluate(const Accumulator& accumulator) const;
+    double evaluate(const ConnectFourState& state) const;
+    std::vector<double> evaluateChildren(const ConnectFourState& state,
+                                         const std::vector<int>& columns) const;
+
+    void load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+    // Raw weights, for offline training tools.
+    alignas(32) int16_t firstWeights[INPUTS][HIDDEN_1];
+    alignas(32) int16_t firstBiases[HIDDEN_1];
+    alignas(32) int8_t secondWeights[HIDDEN_2][HIDDEN_1];
+    int32_t secondBiases[HIDDEN_2];
+    alignas(32) int8_t outputWeights[HIDDEN_2];
+    int32_t outputBias;
+
+   private:
+    static const int SECOND_SHIFT = 6;
+    static constexpr double OUTPUT_SCALE = 127.0 * 64.0;
+
+    static void _addRow(int16_t* values, const int16_t* row);
+    static int32_t _dot(const uint8_t* activations, const int8_t* weights);
+    static void _addRowGeneric(int16_t* values, const int16_t* row);
+    static int32_t _dotGeneric(const uint8_t* activations,
+                               const int8_t* weights);
+#if CPU_HAS_X86_64_V3
+    CPU_X86_64_V3 static void _addRowX86_64_V3(int16_t* values,
+                                                const int16_t* row);
+    CPU_X86_64_V3 static int32_t _dotX86_64_V3(const uint8_t* activations,
+                                               const int8_t* weights);
+#endif
+};
+
+ValueNetwork::ValueNetwork() {
+    std::memset(firstWeights, 0, sizeof(firstWeights));
+    std::memset(firstBiases, 0, sizeof(firstBiases));
+    std::memset(secondWeights, 0, sizeof(secondWeights));
+    std::memset(secondBiases, 0, sizeof(secondBiases));
+    std::memset(outputWeights, 0, sizeof(outputWeights));
+    outputBias = 0;
+}
+
+int ValueNetwork::featureIndex(int column, int row,
+                               ConnectFourState::Player player) {
+    const int PLANE = (player == ConnectFourState::Player::X) ? 0 : 1;
+    return PLANE * 42 + row * 7 + column;
+}
+
+void ValueNetwork::_addRow(int16_t* values, const int16_t* row) {
+#if CPU_HAS_X86_64_V3
+    if (cpu_Target() == CpuTarget::X86_64_V3) {
+        _addRowX86_64_V3(values, row);
+        return;
+    }
+#endif
+    _addRowGeneric(values, row);
+}
+
+int32_t ValueNetwork::_dot(const uint8_t* activations, const int8_t* weights) {
+#if CPU_HAS_X86_64_V3
+    if (cpu_Target() == CpuTarget::X86_64_V3) {
+        return _dotX86_64_V3(activations, weights);
+    }
+#endif
+    return _dotGeneric(activations, weights);
+}
+
+void ValueNetwork::_addRowGeneric(int16_t* values, const int16_t* row) {
+#if defined(__ARM_NEON)
+    for (int i = 0; i < HIDDEN_1; i += 8) {
+        vst1q_s16(values + i, vaddq_s16(vld1q_s16(values + i),
+                                        vld1q_s16(row + i)));
+    }
+#else
+    for (int i = 0; i < HIDDEN_1; ++i) {
+        values[i] += row[i];
+    }
+#endif
+}
+
+int32_t ValueNetwork::_dotGeneric(const uint8_t* activations,
+                                  const int8_t* weights) {
+#if defined(__ARM_NEON)
+    int32x4_t sums = vdupq_n_s32(0);
+    for (int i = 0; i < HIDDEN_1; i += 16) {
+        const int8x16_t INPUT =
+            vreinterpretq_s8_u8(vld1q_u8(activations + i));
+        const int8x16_t WEIGHT = vld1q_s8(weights + i);
+        sums = vpadalq_s16(sums, vmull_s8(vget_low_s8(INPUT),
+                                          vget_low_s8(WEIGHT)));
+        sums = vpadalq_s16(sums, vmull_s8(vget_high_s8(INPUT),
+                                          vget_high_s8(WEIGHT)));
+    }
+    return vaddvq_s32(sums);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < HIDDEN_1; ++i) {
+        sum += activations[i] * weights[i];
+    }
+    return sum;
+#endif
+}
+
+#if CPU_HAS_X86_64_V3
+void ValueNetwork::_addRowX86_64_V3(int16_t* values, const int16_t* row) {
+    for (int i = 0; i < HIDDEN_1; i += 16) {
+        __m256i sum = _mm256_add_epi16(
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i)),
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(row + i)));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values + i), sum);
+    }
+}
+
+int32_t ValueNetwork::_dotX86_64_V3(const uint8_t* activations,
+                                    const int8_t* weights) {
+    // Activations are at most 127, so the pairwise int16 sums cannot
+    // saturate.
+    const __m256i PRODUCTS = _mm256_maddubs_epi16(
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(activations)),
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(weights)));
+    const __m256i SUMS = _mm256_madd_epi16(PRODUCTS, _mm256_set1_epi16(1));
+    const __m128i HALVES = _mm_add_epi32(_mm256_castsi256_si128(SUMS),
+                                         _mm256_extracti128_si256(SUMS, 1));
+    const __m128i QUARTERS =
+        _mm_add_epi32(HALVES, _mm_shuffle_epi32(HALVES, 0x4E));
+    const __m128i EIGHTHS =
+        _mm_add_epi32(QUARTERS, _mm_shuffle_epi32(QUARTERS, 0xB1));
+    return _mm_cvtsi128_si32(EIGHTHS);
+}
+#endif
+
+/**
+ * Rebuild the accumulator from every piece on the board.
+ */
+void ValueNetwork::refresh(Accumulator& accumulator,
+                           const ConnectFourState& state) const {
+    std::memcpy(accumulator.values, firstBiases, sizeof(firstBiases));
+    for (int row = 0; row < 6; ++row) {
+        for (int column = 0; column < 7; ++column) {
+            const ConnectFourState::Player PIECE = state.pieceAt(column, row);
+            if (PIECE != ConnectFourState::Player::None) {
+                addPiece(accumulator, column, row, PIECE);
+            }
+        }
+    }
+}
+
+/**
+ * Update the accumulator for a piece placed on the board.
+ */
+void ValueNetwork::addPiece(Accumulator& accumulator, int column, int row,
+                            ConnectFourState::Player player) const {
+    _addRow(accumulator.values, firstWeights[featureIndex(column, row, player)]);
+}
+
+double ValueNetwork::evaluate(const Accumulator& accumulator) const {
+    alignas(32) uint8_t firstActivations[HIDDEN_1];
+    for (int i = 0; i < HIDDEN_1; ++i) {
+        firstActivations[i] = static_cast<uint8_t>(
+            std::min<int16_t>(std::max<int16_t>(accumulator.values[i], 0), 127));
+    }
+
+    alignas(32) uint8_t secondActivations[HIDDEN_2];
+    for (int i = 0; i < HIDDEN_2; ++i) {
+        const int32_t SUM =
+            (_dot(firstActivations, secondWeights[i]) + secondBiases[i]) >>
+            SECOND_SHIFT;
+        secondActivations[i] =
+            static_cast<uint8_t>(std::min<int32_t>(std::max(SUM, 0), 127));
+    }
+
+    const int32_t OUTPUT = _dot(secondActivations, outputWeights) + outputBias;
+    return std::tanh(OUTPUT / OUTPUT_SCALE);
+}
+
+double ValueNetwork::evaluate(const ConnectFourState& state) const {
+    Accumulator accumulator;
+    refresh(accumulator, state);
+    return evaluate(accumulator);
+}
+
+/**
+ * Evaluate the states after playing each column, for the player to move in
+ * STATE. The parent accumulator is built once and each child only adds its
+ * own piece.
+ */
+std::vector<double> ValueNetwork::evaluateChildren(
+    const ConnectFourState& state, const std::vector<int>& columns) const {
+    const ConnectFourState::Player MOVER = state.currentPlayer();
+    const double SIGN = (MOVER == ConnectFourState::Player::X) ? 1.0 : -1.0;
+
+    Accumulator parent;
+    refresh(parent, state);
+
+    std::vector<double> values;
+    for (int column : columns) {
+        Accumulator child = parent;
+        addPiece(child, column, state.playableRow(column), MOVER);
+        values.push_back(SIGN * evaluate(child));
+    }
+    return values;
+}
+
+void ValueNetwork::load(const std::string& filename) {
+    std::ifstream file(filename, std::ifstream::binary);
+    if (file.fail()) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    char magic[4];
+    uint32_t header[4];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || std::memcmp(magic, "C4VN", 4) != 0 || header[0] != VERSION ||
+        header[1] != INPUTS || header[2] != HIDDEN_1 || header[3] != HIDDEN_2) {
+        throw std::runtime_error("\'" + filename +
+                                 "\' is not a compatible value network.");
+    }
+
+    file.read(reinterpret_cast<char*>(firstWeights), sizeof(firstWeights));
+    file.read(reinterpret_cast<char*>(firstBiases), sizeof(firstBiases));
+    file.read(reinterpret_cast<char*>(secondWeights), sizeof(secondWeights));
+    file.read(reinterpret_cast<char*>(secondBiases), sizeof(secondBiases));
+    file.read(reinterpret_cast<char*>(outputWeights), sizeof(outputWeights));
+    file.read(reinterpret_cast<char*>(&outputBias), sizeof(outputBias));
+    if (!file) {
+        throw std::runtime_error("\'" + filename + "\' is truncated.");
+    }
+}
+
+void ValueNetwork::save(const std::string& filename) const {
+    std::ofstream file(filename, std::ofstream::binary | std::ofstream::trunc);
+    if (file.fail()) {
+        throw std::runtime_error("\'" + filename + "\' could not be opened.");
+    }
+
+    const uint32_t HEADER[4] = {VERSION, INPUTS, HIDDEN_1, HIDDEN_2};
+    file.write("C4VN", 4);
+    file.write(reinterpret_cast<const char*>(HEADER), sizeof(HEADER));
+    file.write(reinterpret_cast<const char*>(firstWeights),
+               sizeof(firstWeights));
+    file.write(reinterpret_cast<const char*>(firstBiases), sizeof(firstBiases));
+    file.write(reinterpret_cast<const char*>(secondWeights),
+               sizeof(secondWeights));
+    file.write(reinterpret_cast<const char*>(secondBiases),
+               sizeof(secondBiases));
+    file.write(reinterpret_cast<const char*>(outputWeights),
+               sizeof(outputWeights));
+    file.write(reinterpret_cast<const char*>(&outputBias), sizeof(outputBias));
+}
+
+/**
+ * The network used to seed pMCTS column scores, or nullptr when none is
+ * loaded. Each evaluation counts as this many playthroughs; heavier priors
+ * drown out the playthroughs of small budgets.
+ */
+std::unique_ptr<ValueNetwork>& pMCTS_ValueNetwork() {
+    static std::unique_ptr<ValueNetwork> network;
+    return network;
+}
+
+long& pMCTS_ValueNetworkPlaythroughs() {
+    static long playthroughs = 30;
+    return playthroughs;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+/**
+ * Runtime selection of instruction set specific kernels, so one portable
+ * build still uses the instructions of the CPU it runs on.
+ *
+ * Kernels are compiled once for the build's baseline and once for each target
+ * below, using function attributes rather than build flags, and the caller
+ * picks a version with cpu_Target(). That is the CPU's best target, unless
+ * overridden with cpu_Select() before any searching starts. This avoids ifunc
+ * and target_clones, which musl (the Alpine image) does not support.
+ *
+ * Targets:
+ *  GENERIC     The build's baseline (x86-64 or arm64 with NEON).
+ *  X86_64_V3   POPCNT, LZCNT, BMI1, BMI2, AVX2 and FMA (Haswell and later).
+ *
+ * Citations
+ *
+ *  https://gcc.gnu.org/onlinedocs/gcc/Common-Function-Attributes.html
+ *      target and flatten attributes.
+ *
+ *  https://gcc.gnu.org/onlinedocs/gcc/x86-Built-in-Functions.html
+ *      __builtin_cpu_supports.
+ *
+ *  https://gitlab.com/x86-psABIs/x86-64-ABI
+ *      x86-64 microarchitecture levels.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_HAS_X86_64_V3 1
+#define CPU_X86_64_V3 \
+    __attribute__((target("popcnt,lzcnt,bmi,bmi2,avx,avx2,fma")))
+// Only the scalar bit instructions of the level, for bitboard code that does
+// not vectorize and would otherwise pay for AVX state transitions whenever it
+// calls into the C library.
+#define CPU_X86_64_V3_SCALAR __attribute__((target("popcnt,lzcnt,bmi,bmi2")))
+#else
+#define CPU_HAS_X86_64_V3 0
+#endif
+
+enum class CpuTarget { GENERIC, X86_64_V3 };
+
+std::string cpuTargetToString(CpuTarget target) {
+    switch (target) {
+        case CpuTarget::GENERIC:
+            return "generic";
+        case CpuTarget::X86_64_V3:
+            return "x86-64-v3";
+        default:
+            throw std::logic_error("An unknown CPU target was passed.");
+    }
+}
+
+/**
+ * Find if this CPU can run kernels compiled for the target.
+ */
+bool cpu_Supports(CpuTarget target) {
+    switch (target) {
+        case CpuTarget::GENERIC:
+            return true;
+        case CpuTarget::X86_64_V3:
+#if CPU_HAS_X86_64_V3
+            // Every feature CPU_X86_64_V3 enables, so masked features (LZCNT
+            // under some hypervisors) fall back to the generic kernels.
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("popcnt") &&
+                   __builtin_cpu_supports("lzcnt") &&
+                   __builtin_cpu_supports("bmi") &&
+                   __builtin_cpu_supports("bmi2") &&
+                   __builtin_cpu_supports("avx") &&
+                   __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma");
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * Get the best target this CPU supports.
+ */
+CpuTarget cpu_Detect() {
+    return cpu_Supports(CpuTarget::X86_64_V3) ? CpuTarget::X86_64_V3
+                                              : CpuTarget::GENERIC;
+}
+
+CpuTarget& cpu_SelectedTarget() {
+    static CpuTarget target = cpu_Detect();
+    return target;
+}
+
+/**
+ * Get the target kernels should run.
+ */
+CpuTarget cpu_Target() { return cpu_SelectedTarget(); }
+
+/**
+ * Override the target by name, or go back to the detected one with "auto".
+ */
+void cpu_Select(const std::string& name) {
+    if (name == "auto") {
+        cpu_SelectedTarget() = cpu_Detect();
+        return;
+    }
+
+    for (CpuTarget target : {CpuTarget::GENERIC, CpuTarget::X86_64_V3}) {
+        if (name == cpuTargetToString(target)) {
+            if (!cpu_Supports(target)) {
+                throw std::runtime_error("\'" + name +
+                                         "\' is not supported by this CPU.");
+            }
+            cpu_SelectedTarget() = target;
+            return;
+        }
+    }
+    throw std::invalid_argument("\'" + name + "\' is not a CPU target.");
+}
@@ -0,0 +1,259 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Hardware performance counters for profiling searches, read through Linux
+ * perf_event_open. Counters the kernel refuses (no PMU, inside a container,
+ * perf_event_paranoid too high, or not Linux) are reported as -1 and
+ * everything else keeps working.
+ *
+ * Counters only count the calling thread, in user space. They are opened as
+ * one group, so they are scheduled onto the PMU together and their ratios
+ * stay consistent. When the kernel has to multiplex the group with other
+ * events, counts are scaled up by the time the group was enabled over the
+ * time it ran; a group that never ran reports -1.
+ *
+ * Citations
+ *
+ *  https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+ */
+
+enum class PerfCounter {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_MISSES,
+    LLC_MISSES,
+    PAGE_FAULTS
+};
+
+const int PERF_COUNTERS = 6;
+
+struct PerfSample {
+    PerfSample() { values.fill(-1); }
+
+    // -1 when the counter is unavailable.
+    std::array<std::int64_t, PERF_COUNTERS> values;
+
+    std::int64_t operator[](PerfCounter counter) const {
+        return values[static_cast<int>(counter)];
+    }
+
+    bool available() const {
+        for (std::int64_t value : values) {
+            if (value >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    PerfSample operator-(const PerfSample& earlier) const {
+        PerfSample difference;
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            if (values[i] >= 0 && earlier.values[i] >= 0) {
+                difference.values[i] = values[i] - earlier.values[i];
+            }
+        }
+        return difference;
+    }
+
+    static std::string csvHeader(const std::string& prefix = "") {
+        return prefix + "cycles," + prefix + "instructions," + prefix +
+               "branch_misses," + prefix + "l1d_misses," + prefix +
+               "llc_misses," + prefix + "page_faults";
+    }
+
+    std::string toCSV() const {
+        std::string csv;
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            csv += ((i > 0) ? "," : "") + std::to_string(values[i]);
+        }
+        return csv;
+    }
+
+    std::string toJSON() const {
+        const char* NAMES[PERF_COUNTERS] = {
+            "cycles",     "instructions", "branch_misses",
+            "l1d_misses", "llc_misses",   "page_faults"};
+        std::string json = "{";
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            json += std::string((i > 0) ? "," : "") + "\"" + NAMES[i] +
+                    "\":" +
+                    ((values[i] >= 0) ? std::to_string(values[i]) : "null");
+        }
+        return json + "}";
+    }
+};
+
+/**
+ * Counter readings per search phase, in the order they happened.
+ */
+typedef std::vector<std::pair<std::string, PerfSample>> PerfProfile;
+
+class PerfCounters {
+   public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    PerfSample read() const;
+
+   private:
+    std::array<int, PERF_COUNTERS> _fds;
+    int _leader;
+    // The counters in the order the group reports them.
+    std::vector<int> _members;
+};
+
+PerfCounters::PerfCounters() : _leader(-1) {
+    _fds.fill(-1);
+
+#if defined(__linux__)
+    const std::uint32_t TYPES[PERF_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE};
+    const std::uint64_t CONFIGS[PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_SW_PAGE_FAULTS};
+
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        perf_event_attr attributes = perf_event_attr();
+        attributes.size = sizeof(attributes);
+        attributes.type = TYPES[i];
+        attributes.config = CONFIGS[i];
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP |
+                                 PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                 PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // This thread, on any CPU, counting from now on, led by the first
+        // counter that opens.
+        _fds[i] = syscall(SYS_perf_event_open, &attributes, 0, -1, _leader, 0);
+        if (_fds[i] >= 0) {
+            if (_leader < 0) {
+                _leader = _fds[i];
+            }
+            _members.push_back(i);
+        }
+    }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+    for (int fd : _fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::available() const {
+    for (int fd : _fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Read the running totals. Subtract two readings to get the counts between
+ * them.
+ */
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+#if defined(__linux__)
+    // Number of counters, time enabled, time running, then the counts.
+    std::uint64_t group[3 + PERF_COUNTERS];
+    const ssize_t SIZE = (3 + _members.size()) * sizeof(std::uint64_t);
+    if (_leader < 0 || ::read(_leader, group, sizeof(group)) != SIZE ||
+        group[0] != _members.size() || group[2] == 0) {
+        return sample;
+    }
+
+    const long double SCALE = static_cast<long double>(group[1]) / group[2];
+    for (size_t i = 0; i < _members.size(); ++i) {
+        sample.values[_members[i]] =
+            static_cast<std::int64_t>(group[3 + i] * SCALE);
+    }
+#endif
+    return sample;
+}
+
+/**
+ * Counters for the calling thread, opened on first use.
+ */
+const PerfCounters& threadPerfCounters() {
+    thread_local PerfCounters counters;
+    return counters;
+}
+
+/**
+ * Splits counts into consecutive phases. Does nothing when disabled, so it can
+ * stay in hot code.
+ */
+class PerfPhases {
+   public:
+    PerfPhases(bool enabled);
+
+    void mark(const std::string& phase);
+    PerfProfile profile() const;
+
+   private:
+    const bool _ENABLED;
+    PerfSample _start;
+    PerfSample _last;
+    PerfProfile _phases;
+};
+
+PerfPhases::PerfPhases(bool enabled) : _ENABLED(enabled) {
+    if (_ENABLED) {
+        _start = threadPerfCounters().read();
+        _last = _start;
+    }
+}
+
+/**
+ * End the current phase, naming it.
+ */
+void PerfPhases::mark(const std::string& phase) {
+    if (_ENABLED) {
+        const PerfSample NOW = threadPerfCounters().read();
+        _phases.push_back({phase, NOW - _last});
+        _last = NOW;
+    }
+}
+
+/**
+ * Get the "total" followed by every phase, or nothing when disabled.
+ */
+PerfProfile PerfPhases::profile() const {
+    PerfProfile profile;
+    if (_ENABLED) {
+        profile.push_back({"total", _last - _start});
+        profile.insert(profile.end(), _phases.begin(), _phases.end());
+    }
+    return profile;
+}
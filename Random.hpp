@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Per-thread pseudo random numbers for playthroughs, so that threads running
+ * searches at the same time neither share nor lock a generator as rand()
+ * does.
+ *
+ * Every thread starts from its own seed. seedRandom() only reseeds the
+ * calling thread.
+ *
+ * Citations
+ *
+ *  https://prng.di.unimi.it/xoshiro128plusplus.c
+ *  https://prng.di.unimi.it/splitmix64.c
+ *      Generator and seeding.
+ */
+
+const std::uint32_t RANDOM_MAX = 0x7fffffff;
+
+std::atomic<std::uint64_t>& randomSeedSequence() {
+    static std::atomic<std::uint64_t> sequence(0x853c49e6748fea9bULL);
+    return sequence;
+}
+
+struct RandomState {
+    std::uint32_t words[4];
+
+    void seed(std::uint64_t seed) {
+        for (int i = 0; i < 4; i += 2) {
+            std::uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            z ^= z >> 31;
+            words[i] = static_cast<std::uint32_t>(z);
+            words[i + 1] = static_cast<std::uint32_t>(z >> 32);
+        }
+    }
+
+    std::uint32_t next() {
+        const auto rotate = [](std::uint32_t x, int k) {
+            return (x << k) | (x >> (32 - k));
+        };
+        const std::uint32_t RESULT = rotate(words[0] + words[3], 7) + words[0];
+        const std::uint32_t T = words[1] << 9;
+        words[2] ^= words[0];
+        words[3] ^= words[1];
+        words[1] ^= words[2];
+        words[0] ^= words[3];
+        words[2] ^= T;
+        words[3] = rotate(words[3], 11);
+        return RESULT;
+    }
+};
+
+RandomState& threadRandomState() {
+    thread_local RandomState state = []() {
+        RandomState fresh;
+        fresh.seed(randomSeedSequence().fetch_add(0x9e3779b97f4a7c15ULL));
+        return fresh;
+    }();
+    return state;
+}
+
+/**
+ * Seed the calling thread's generator. Threads started afterwards also
+ * derive their seeds from the most recent seed.
+ */
+void seedRandom(std::uint64_t seed) {
+    threadRandomState().seed(seed);
+    randomSeedSequence() = seed * 0xd1342543de82ef95ULL + 1;
+}
+
+/**
+ * Get a random integer in [0, RANDOM_MAX], like rand().
+ */
+int randomInt() { return threadRandomState().next() >> 1; }